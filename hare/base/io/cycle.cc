@@ -290,7 +290,8 @@ void Cycle::QueueInCycle(Task _task) {
     IMPL->pending_functions.push_back(std::move(_task));
   }
 
-  if (!InCycleThread()) {
+  // tasks queued by pending functions must not wait for the next event.
+  if (!InCycleThread() || IMPL->calling_pending_functions) {
     Notify();
   }
 }
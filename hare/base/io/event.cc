@@ -55,7 +55,8 @@ Event::Event(util_socket_t _fd, Callback _cb, std::uint8_t _events,
   IMPL->events = _events;
   IMPL->callback = std::move(_cb);
   IMPL->timeval = _timeval;
-  if (CHECK_EVENT(IMPL->events, EVENT_TIMEOUT) != 0 &&
+  // only the timer can be persistent.
+  if (_fd >= 0 && CHECK_EVENT(IMPL->events, EVENT_TIMEOUT) != 0 &&
       CHECK_EVENT(IMPL->events, EVENT_PERSIST) != 0) {
     CLEAR_EVENT(IMPL->events, EVENT_TIMEOUT);
     IMPL->timeval = 0;
@@ -149,9 +150,9 @@ void Event::HandleEvent(std::uint8_t _flag, Timestamp& _receive_time) {
     if (!object) {
       return;
     }
-    if (IMPL->callback) {
-      IMPL->callback(shared_from_this(), _flag, _receive_time);
-    }
+  }
+  if (IMPL->callback) {
+    IMPL->callback(shared_from_this(), _flag, _receive_time);
   }
 }
 
@@ -34,9 +34,10 @@ struct TimerElem {
   TimerElem(Event::Id _id, Timestamp _stamp) : id(_id), stamp(_stamp) {}
 };
 
+// the earliest timer is on the top.
 struct TimerPriority {
   auto operator()(const TimerElem& _elem_x, const TimerElem& _elem_y) -> bool {
-    return _elem_x.stamp < _elem_y.stamp;
+    return _elem_y.stamp < _elem_x.stamp;
   }
 };
 
@@ -1,6 +1,7 @@
 #include <hare/base/exception.h>
 #include <hare/base/util/system.h>
 #include <hare/base/util/system_check.h>
+#include <hare/hare-config.h>
 
 #include <array>
 #include <chrono>
@@ -10,6 +11,11 @@
 
 #include "base/fwd-inl.h"
 
+#if HARE__HAVE_PTHREAD_SETAFFINITY_NP
+#include <pthread.h>
+#include <sched.h>
+#endif
+
 #ifndef H_OS_WIN
 #include <arpa/inet.h>
 #include <cxxabi.h>
@@ -369,6 +375,22 @@ auto SetCurrentThreadName(const char* _tname) -> bool {
   return ret != -1;
 }
 
+auto SetCurrentThreadAffinity(std::int32_t _cpu) -> bool {
+#if HARE__HAVE_PTHREAD_SETAFFINITY_NP
+  if (_cpu < 0 || _cpu >= CPU_SETSIZE) {
+    return false;
+  }
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  CPU_SET(_cpu, &cpu_set);
+  return ::pthread_setaffinity_np(::pthread_self(), sizeof(cpu_set),
+                                  &cpu_set) == 0;
+#else
+  IgnoreUnused(_cpu);
+  return false;
+#endif
+}
+
 auto ErrnoStr(std::int32_t _errorno) -> const char* {
   static thread_local std::array<char, HARE_SMALL_FIXED_SIZE *
                                            HARE_SMALL_FIXED_SIZE / 2>
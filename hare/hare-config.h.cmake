@@ -187,6 +187,12 @@
 /* Define to 1 if you have the <netinet/tcp.h> header file. */
 #cmakedefine HARE__HAVE_NETINET_TCP_H 1
 
+/* Define to 1 if you have the <linux/errqueue.h> header file. */
+#cmakedefine HARE__HAVE_LINUX_ERRQUEUE_H 1
+
+/* Define to 1 if you have the <linux/sockios.h> header file. */
+#cmakedefine HARE__HAVE_LINUX_SOCKIOS_H 1
+
 /* Define to 1 if you have the <sys/un.h> header file. */
 #cmakedefine HARE__HAVE_SYS_UN_H 1
 
@@ -217,6 +223,18 @@
 /* Define to 1 if you have the <port.h> header file. */
 #cmakedefine HARE__HAVE_PORT_H 1
 
+/* Define to 1 if you have the <pthread.h> header file. */
+#cmakedefine HARE__HAVE_PTHREAD_H 1
+
+/* Define to 1 if you have the `pthread_setaffinity_np' function. */
+#cmakedefine HARE__HAVE_PTHREAD_SETAFFINITY_NP 1
+
+/* Define to 1 if you have the <sched.h> header file. */
+#cmakedefine HARE__HAVE_SCHED_H 1
+
+/* Define to 1 if you have the `pread' function. */
+#cmakedefine HARE__HAVE_PREAD 1
+
 /* Define if we have pthreads on this system */
 #cmakedefine HARE__HAVE_PTHREADS 1
 
@@ -4,6 +4,8 @@
 #include <hare/base/util/buffer.h>
 #include <hare/net/buffer.h>
 
+#include <vector>
+
 #include "base/fwd-inl.h"
 
 #define MAX_TO_REALIGN 2048U
@@ -28,6 +30,12 @@ namespace detail {
 class Cache : public util::Buffer<char> {
   std::size_t misalign_{0};
 
+  Ptr<BufferBudget> budget_{};
+
+  // the id of the last zero-copy send which refers to this block.
+  std::uint32_t pin_id_{0};
+  bool pinned_{false};
+
  public:
   using Base = util::Buffer<char>;
 
@@ -40,7 +48,26 @@ class Cache : public util::Buffer<char> {
       : Base(_data, _max_size, _max_size) {}
 
   HARE_INLINE
-  ~Cache() override { delete[] Begin(); }
+  ~Cache() override {
+    if (budget_) {
+      budget_->Discharge(capacity());
+    }
+    delete[] Begin();
+  }
+
+  HARE_INLINE void Charge(Ptr<BufferBudget> _budget) {
+    budget_ = std::move(_budget);
+    budget_->Charge(capacity());
+  }
+
+  // before pooled, it is charged again when reused.
+  HARE_INLINE void Discharge() {
+    if (budget_) {
+      budget_->Discharge(capacity());
+      budget_.reset();
+    }
+    Clear();
+  }
 
   // write to data_ directly
   HARE_INLINE auto Writeable() -> Base::ValueType* { return Begin() + size(); }
@@ -55,18 +82,34 @@ class Cache : public util::Buffer<char> {
   HARE_INLINE auto ReadableSize() const -> std::size_t {
     return size() - misalign_;
   }
+  HARE_INLINE auto Misalign() const -> std::size_t { return misalign_; }
   HARE_INLINE auto Full() const -> bool { return size() == capacity(); }
   HARE_INLINE auto Empty() const -> bool { return ReadableSize() == 0; }
   HARE_INLINE void Clear() {
     Base::Clear();
     misalign_ = 0;
+    pinned_ = false;
+  }
+
+  /**
+   * @brief A pinned block is still referred by the kernel, so its content
+   *   must not be moved or overwritten until the send is completed.
+   **/
+  HARE_INLINE auto Pinned() const -> bool { return pinned_; }
+  HARE_INLINE auto PinId() const -> std::uint32_t { return pin_id_; }
+  HARE_INLINE void Pin(std::uint32_t _id) {
+    pin_id_ = _id;
+    pinned_ = true;
   }
+  HARE_INLINE void Unpin() { pinned_ = false; }
 
   HARE_INLINE void Drain(std::size_t _size) { misalign_ += _size; }
   HARE_INLINE void Add(std::size_t _size) { size_ += _size; }
 
   HARE_INLINE void Bzero() { hare::detail::FillN(Data(), capacity(), 0); }
 
+  virtual auto IsFile() const -> bool { return false; }
+
   auto Realign(std::size_t _size) -> bool;
 
  private:
@@ -77,7 +120,63 @@ class Cache : public util::Buffer<char> {
   friend class net::Buffer;
 };
 
-using Ucache = UPtr<detail::Cache>;
+struct FileHandle {
+  std::int32_t fd{-1};
+  bool auto_close{false};
+
+  FileHandle(std::int32_t _fd, bool _auto_close)
+      : fd(_fd), auto_close(_auto_close) {}
+  ~FileHandle();
+};
+
+/**
+ * @brief The file segment of buffer. It holds [offset, offset + length)
+ *   of a file instead of memory, so it will be sent by sendfile(2) and
+ *   never be copied into the user-space.
+ *
+ *   The segment is always full, so nothing can be written into it.
+ **/
+class FileCache : public Cache {
+  Ptr<FileHandle> file_{};
+  std::int64_t offset_{0};
+
+ public:
+  HARE_INLINE
+  FileCache(Ptr<FileHandle> _file, std::int64_t _offset, std::size_t _length)
+      : Cache(nullptr, _length), file_(std::move(_file)), offset_(_offset) {}
+
+  ~FileCache() override = default;
+
+  HARE_INLINE auto Handle() const -> const Ptr<FileHandle>& { return file_; }
+  HARE_INLINE auto fd() const -> std::int32_t { return file_->fd; }
+  HARE_INLINE auto Offset() const -> std::int64_t {
+    return offset_ + static_cast<std::int64_t>(Misalign());
+  }
+  HARE_INLINE auto EndOffset() const -> std::int64_t {
+    return offset_ + static_cast<std::int64_t>(size());
+  }
+
+  // grows the segment by the bytes appended to the file right after it.
+  HARE_INLINE void Extend(std::size_t _size) {
+    size_ += _size;
+    capacity_ += _size;
+  }
+
+  auto IsFile() const -> bool override { return true; }
+};
+
+/**
+ * @brief Blocks of the pooled sizes go back to the pool of the thread
+ *   which frees them, see `Buffer::SetBlockPool()`.
+ **/
+struct CacheDeleter {
+  void operator()(Cache* _cache) const;
+};
+
+using Ucache = std::unique_ptr<detail::Cache, CacheDeleter>;
+
+// a block from the pool of this thread, or a new one.
+auto AllocCache(std::size_t _size) -> Cache*;
 
 /** @code
  *  +-------++-------++-------++-------++-------++-------+
@@ -101,6 +200,23 @@ struct CacheList {
   Node* write{};
   std::size_t node_size_{0};
 
+  /**
+   * @brief The drained blocks which are still pinned by zero-copy sends,
+   *   and the ids of the next and the first uncompleted send. They are not
+   *   exchanged by `Swap()`, because they belong to the socket.
+   **/
+  std::vector<Ucache> pinned{};
+  std::uint32_t zc_next{0};
+  std::uint32_t zc_done{0};
+
+  // null means the global budget, it is not exchanged by `Swap()` too.
+  Ptr<BufferBudget> budget{};
+
+  // the trim policy, see `Buffer::SetTrimPolicy()`. Not exchanged either.
+  std::size_t max_retained{0};
+  std::uint32_t idle_rounds{0};
+  std::uint32_t empty_rounds{0};
+
   HARE_INLINE
   CacheList() : head(new Node), read(head), write(head), node_size_(1) {
     head->next = head;
@@ -131,28 +247,99 @@ struct CacheList {
     std::swap(node_size_, _other.node_size_);
   }
 
+  HARE_INLINE auto NewCache(std::size_t _size) -> Cache* {
+    auto* cache = AllocCache(_size);
+    cache->Charge(budget ? budget : BufferBudget::Global());
+    return cache;
+  }
+
   void CheckSize(std::size_t _size);
 
   void Append(CacheList& _other);
 
   auto FastExpand(std::size_t _size) -> std::int32_t;
 
+  void AddFile(Ucache _file);
+
   void Add(std::size_t _size);
 
   void Drain(std::size_t _size);
 
   void Reset();
 
+  /**
+   * @brief Frees the spare blocks after `End()`, and the last one if the
+   *   list is empty.
+   **/
+  void Shrink();
+
+  /**
+   * @brief Applies the trim policy after draining.
+   **/
+  void Trim();
+
+  HARE_INLINE auto Completed(std::uint32_t _id) const -> bool {
+    return static_cast<std::int32_t>(_id - zc_done) < 0;
+  }
+
+  // whether a block of the list is still referred by a zero-copy send.
+  HARE_INLINE auto HasPinned() const -> bool {
+    auto* index = head;
+    do {
+      if (index->cache && (*index)->Pinned() &&
+          !Completed((*index)->PinId())) {
+        return true;
+      }
+      index = index->next;
+    } while (index != head);
+    return false;
+  }
+
+  /**
+   * @brief Pins the blocks from `Begin()` to `_last` with a new send id.
+   **/
+  void Pin(Node* _last);
+
+  /**
+   * @brief All sends before `_done` have been completed by the kernel.
+   **/
+  void Unpin(std::uint32_t _done);
+
 #ifdef HARE_DEBUG
   void PrintStatus(const std::string& _status) const;
 #endif
 
  private:
+  /**
+   * @brief The drained file segment cannot be reused to write,
+   *   so it will be released.
+   **/
+  static void Recycle(Node* _node) {
+    if (_node->cache && (*_node)->IsFile()) {
+      _node->cache.reset();
+    } else if (_node->cache) {
+      (*_node)->Clear();
+    }
+  }
+
+  void Release(Node* _node) {
+    if (_node->cache && (*_node)->Pinned() && !Completed((*_node)->PinId())) {
+      pinned.emplace_back(std::move(_node->cache));
+    } else {
+      Recycle(_node);
+    }
+  }
+
+  void Free(Node* _node) {
+    if (_node->cache && (*_node)->Pinned() && !Completed((*_node)->PinId())) {
+      pinned.emplace_back(std::move(_node->cache));
+    }
+    _node->cache.reset();
+  }
+
   auto GetNextWrite() -> Node* {
     if (!write->cache || (*write)->Empty()) {
-      if (write->cache) {
-        (*write)->Clear();
-      }
+      Recycle(write);
       return End();
     } else if (write->next == read) {
       auto* tmp = new Node;
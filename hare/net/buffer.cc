@@ -1,14 +1,53 @@
 #include <hare/base/exception.h>
+#include <hare/base/io/operation.h>
+#include <hare/base/util/system.h>
 #include <hare/hare-config.h>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <string>
 #include <vector>
 
 #include "base/fwd-inl.h"
 #include "net/buffer-inl.h"
 #include "socket_op.h"
 
-#if HARE__HAVE_SYS_IOCTL_H
-#include <sys/ioctl.h>
+#if HARE__HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#if HARE__HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif
+
+#if HARE__HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+#if HARE__HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#endif
+
+#if HARE__HAVE_LINUX_ERRQUEUE_H && defined(MSG_ZEROCOPY)
+#include <linux/errqueue.h>
+#define USE_ZEROCOPY_IMPL
+#endif
+
+#if HARE__HAVE_SENDFILE && HARE__HAVE_SYS_SENDFILE_H
+#include <sys/sendfile.h>
+#define USE_SENDFILE_IMPL
+#endif
+
+#if HARE__HAVE_SYS_SOCKET_H && defined(SO_TIMESTAMPNS)
+#define USE_RX_TIMESTAMP_IMPL
+#endif
+
+#if HARE__HAVE_FCNTL_H && HARE__HAVE_UNISTD_H && \
+    (defined(USE_SENDFILE_IMPL) || HARE__HAVE_PREAD)
+#define USE_SPILL_IMPL
 #endif
 
 #if defined(HARE__HAVE_SYS_UIO_H) || defined(H_OS_WIN32)
@@ -43,8 +82,26 @@
 #define IOV_LEN_FIELD len
 #define IOV_LEN_TYPE unsigned long
 #endif
+
+/**
+ * @brief The spill area is appended to the iovec of every read, so that one
+ *   readv(2) is enough even if the learned size is too small.
+ **/
+#define READ_SPILL_SIZE MAX_TO_ALLOC
+#define MIN_READ_HINT MIN_TO_ALLOC
+#define MAX_READ_HINT MAX_TO_ALLOC
 #endif
 
+#define MAX_VARINT_SIZE 10U
+
+// spare blocks kept by a buffer after draining.
+#define DEFAULT_MAX_RETAINED (MAX_TO_ALLOC * 2)
+
+// the sizes of pooled blocks are powers of two from MIN_TO_ALLOC to
+// MAX_TO_ALLOC.
+#define POOL_CLASSES 5
+#define DEFAULT_POOL_BYTES (1024UL * 1024)
+
 namespace hare {
 namespace net {
 
@@ -81,13 +138,287 @@ static auto get_next(const char* _begin, std::size_t _size)
   return next;
 }
 
+static auto send_file(util_socket_t _fd, const FileCache& _file,
+                      std::size_t _size) -> std::int64_t {
+#ifdef USE_SENDFILE_IMPL
+  auto offset = static_cast<off_t>(_file.Offset());
+  return ::sendfile(_fd, _file.fd(), &offset, _size);
+#elif HARE__HAVE_PREAD
+  std::array<char, HARE_SMALL_BUFFER> cache{};
+  auto read_n = ::pread(_file.fd(), cache.data(), Min(_size, cache.size()),
+                        _file.Offset());
+  if (read_n <= 0) {
+    return -1;
+  }
+  return socket_op::Write(_fd, cache.data(),
+                          hare::detail::ToUnsigned(read_n));
+#else
+  IgnoreUnused(_fd, _file, _size);
+  HARE_INTERNAL_ERROR("file segment is not supported.");
+  return -1;
+#endif
+}
+
+#ifdef USE_RX_TIMESTAMP_IMPL
+/**
+ * @brief readv(2) by recvmsg(2), the receive time is taken from the
+ *   SCM_TIMESTAMPNS or the software stamp of SCM_TIMESTAMPING.
+ **/
+static auto read_stamped(util_socket_t _fd, struct iovec* _vecs,
+                         std::int32_t _count, Timestamp& _time)
+    -> std::int64_t {
+  alignas(struct cmsghdr)
+      std::array<char, CMSG_SPACE(sizeof(struct timespec) * 3)> control{};
+  struct msghdr msg {};
+  msg.msg_iov = _vecs;
+  msg.msg_iovlen = static_cast<std::size_t>(_count);
+  msg.msg_control = control.data();
+  msg.msg_controllen = control.size();
+
+  auto actual = ::recvmsg(_fd, &msg, 0);
+  _time = Timestamp();
+  if (actual <= 0) {
+    return actual;
+  }
+
+  for (auto* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr;
+       cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (cmsg->cmsg_level != SOL_SOCKET ||
+        (cmsg->cmsg_type != SCM_TIMESTAMPNS
+#ifdef SCM_TIMESTAMPING
+         && cmsg->cmsg_type != SCM_TIMESTAMPING
+#endif
+         )) {
+      continue;
+    }
+    struct timespec stamp {};
+    ::memcpy(&stamp, CMSG_DATA(cmsg), sizeof(stamp));
+    if (stamp.tv_sec != 0 || stamp.tv_nsec != 0) {
+      _time = Timestamp(static_cast<std::int64_t>(stamp.tv_sec) *
+                            HARE_MICROSECONDS_PER_SECOND +
+                        stamp.tv_nsec / 1000);
+    }
+  }
+  return actual;
+}
+#endif
+
+static auto read_file(const FileCache& _file, char* _dest, std::size_t _size)
+    -> bool {
+#if HARE__HAVE_PREAD
+  std::size_t total{0};
+  while (total < _size) {
+    auto read_n =
+        ::pread(_file.fd(), _dest + total, _size - total,
+                _file.Offset() + static_cast<std::int64_t>(total));
+    if (read_n <= 0) {
+      return false;
+    }
+    total += hare::detail::ToUnsigned(read_n);
+  }
+  return true;
+#else
+  IgnoreUnused(_file, _dest, _size);
+  HARE_INTERNAL_ERROR("file segment is not supported.");
+  return false;
+#endif
+}
+
+static auto copy_out(const CacheList& _list, char* _dest, std::size_t _length)
+    -> std::size_t {
+  auto* curr{_list.Begin()};
+  std::size_t total{0};
+  while (total < _length) {
+    auto copy_len = Min(_length - total, (*curr)->ReadableSize());
+    if ((*curr)->IsFile()) {
+      if (!read_file(*DownCast<FileCache*>(curr->cache.get()), _dest + total,
+                     copy_len)) {
+        HARE_INTERNAL_ERROR("cannot read file segment of buffer.");
+        break;
+      }
+    } else {
+      std::memcpy(_dest + total, (*curr)->Readable(), copy_len);
+    }
+    total += copy_len;
+    curr = curr->next;
+  }
+  return total;
+}
+
+static HARE_INLINE auto to_network(std::uint16_t _value) -> std::uint16_t {
+  return io::HostToNetwork16(_value);
+}
+static HARE_INLINE auto to_network(std::uint32_t _value) -> std::uint32_t {
+  return io::HostToNetwork32(_value);
+}
+static HARE_INLINE auto to_network(std::uint64_t _value) -> std::uint64_t {
+  return io::HostToNetwork64(_value);
+}
+static HARE_INLINE auto to_network(std::uint8_t _value) -> std::uint8_t {
+  return _value;
+}
+
+template <typename T>
+static auto add_int(Buffer& _buffer, T _value, Endian _endian) -> bool {
+  std::array<std::uint8_t, sizeof(T)> bytes{};
+  if (_endian == ENDIAN_BIG) {
+    _value = to_network(_value);
+    std::memcpy(bytes.data(), &_value, sizeof(T));
+  } else {
+    for (std::size_t i = 0; i < sizeof(T); ++i) {
+      bytes[i] = static_cast<std::uint8_t>(_value >> (i * 8));
+    }
+  }
+  return _buffer.Add(bytes.data(), sizeof(T));
+}
+
+/**
+ * @brief Reads the integer without draining, copies directly from the first
+ *   block when the integer lies within it.
+ **/
+template <typename T>
+static auto peek_int(const CacheList& _list, std::size_t _total, T& _value,
+                     Endian _endian) -> bool {
+  if (_total < sizeof(T)) {
+    return false;
+  }
+  std::array<std::uint8_t, sizeof(T)> bytes{};
+  auto* begin = _list.Begin();
+  if (!(*begin)->IsFile() && (*begin)->ReadableSize() >= sizeof(T)) {
+    std::memcpy(bytes.data(), (*begin)->Readable(), sizeof(T));
+  } else if (copy_out(_list, reinterpret_cast<char*>(bytes.data()),
+                      sizeof(T)) != sizeof(T)) {
+    return false;
+  }
+
+  if (_endian == ENDIAN_BIG) {
+    std::memcpy(&_value, bytes.data(), sizeof(T));
+    _value = to_network(_value);
+  } else {
+    _value = 0;
+    for (std::size_t i = 0; i < sizeof(T); ++i) {
+      _value = static_cast<T>(_value | static_cast<T>(bytes[i]) << (i * 8));
+    }
+  }
+  return true;
+}
+
+// 0 if incomplete, -1 if malformed, otherwise the size of varint.
+static auto decode_varint(const std::uint8_t* _bytes, std::size_t _size,
+                          std::uint64_t& _value) -> std::int32_t {
+  std::uint64_t value{0};
+  auto limit = Min(_size, std::size_t(MAX_VARINT_SIZE));
+  for (std::size_t i = 0; i < limit; ++i) {
+    // only the lowest bit of the last byte fits in 64 bits.
+    if (i == MAX_VARINT_SIZE - 1 && _bytes[i] > 1) {
+      return -1;
+    }
+    value |= static_cast<std::uint64_t>(_bytes[i] & 0x7f) << (i * 7);
+    if ((_bytes[i] & 0x80) == 0) {
+      _value = value;
+      return static_cast<std::int32_t>(i + 1);
+    }
+  }
+  return limit == MAX_VARINT_SIZE ? -1 : 0;
+}
+
+FileHandle::~FileHandle() {
+  if (auto_close && fd >= 0) {
+    IgnoreUnused(::close(fd));
+  }
+}
+
+static std::atomic<std::size_t> pool_limit{DEFAULT_POOL_BYTES};
+
+class CachePool : public util::NonCopyable {
+  std::array<std::vector<Cache*>, POOL_CLASSES> free_{};
+  std::size_t bytes_{0};
+
+ public:
+  CachePool() = default;
+  ~CachePool() {
+    Exited() = true;
+    for (auto& caches : free_) {
+      for (auto* cache : caches) {
+        delete cache;
+      }
+    }
+  }
+
+  // null while the thread is exiting.
+  static auto Local() -> CachePool* {
+    static thread_local CachePool pool{};
+    return Exited() ? nullptr : &pool;
+  }
+
+  static auto ClassOf(std::size_t _size) -> std::int32_t {
+    auto index{0};
+    for (std::size_t size = MIN_TO_ALLOC; size <= MAX_TO_ALLOC; size <<= 1) {
+      if (size == _size) {
+        return index;
+      }
+      ++index;
+    }
+    return -1;
+  }
+
+  auto Get(std::size_t _size) -> Cache* {
+    auto index = ClassOf(_size);
+    if (index < 0 || free_[index].empty()) {
+      return nullptr;
+    }
+    auto* cache = free_[index].back();
+    free_[index].pop_back();
+    bytes_ -= _size;
+    return cache;
+  }
+
+  auto Put(Cache* _cache) -> bool {
+    auto index = ClassOf(_cache->capacity());
+    auto limit = pool_limit.load(std::memory_order_relaxed);
+    if (index < 0 || bytes_ + _cache->capacity() > limit) {
+      return false;
+    }
+    _cache->Discharge();
+    free_[index].push_back(_cache);
+    bytes_ += _cache->capacity();
+    return true;
+  }
+
+ private:
+  static auto Exited() -> bool& {
+    static thread_local bool exited{false};
+    return exited;
+  }
+};
+
+void CacheDeleter::operator()(Cache* _cache) const {
+  if (!_cache->IsFile() && !_cache->Pinned()) {
+    auto* pool = CachePool::Local();
+    if (pool != nullptr && pool->Put(_cache)) {
+      return;
+    }
+  }
+  delete _cache;
+}
+
+auto AllocCache(std::size_t _size) -> Cache* {
+  auto* pool = CachePool::Local();
+  auto* cache = pool != nullptr ? pool->Get(_size) : nullptr;
+  return cache != nullptr ? cache : new Cache(_size);
+}
+
 auto Cache::Realign(std::size_t _size) -> bool {
+  if (IsFile()) {
+    return false;
+  }
   auto offset = ReadableSize();
   if (WriteableSize() >= _size) {
     return true;
-  } else if (WriteableSize() + misalign_ > _size && offset <= MAX_TO_REALIGN) {
+  } else if (!pinned_ && WriteableSize() + misalign_ > _size &&
+             offset <= MAX_TO_REALIGN) {
     ::memmove(Begin(), Readable(), offset);
-    Set(Begin(), offset);
+    size_ = offset;
     misalign_ = 0;
     return true;
   }
@@ -96,11 +427,11 @@ auto Cache::Realign(std::size_t _size) -> bool {
 
 void CacheList::CheckSize(std::size_t _size) {
   if (!write->cache) {
-    write->cache.reset(new Cache(round_up(_size)));
+    write->cache.reset(NewCache(round_up(_size)));
   } else if (!(*write)->Realign(_size)) {
     GetNextWrite();
     if (!write->cache || (*write)->size() < _size) {
-      write->cache.reset(new Cache(round_up(_size)));
+      write->cache.reset(NewCache(round_up(_size)));
     }
   }
 }
@@ -122,10 +453,11 @@ void CacheList::Append(CacheList& _other) {
     //   ---+---++---+---
     //        ^    ^
     //      write read
+    auto* after_write = End()->next;
     End()->next = other_begin;
     other_begin->prev = End();
-    Begin()->prev = other_end;
-    other_end->next = Begin();
+    after_write->prev = other_end;
+    other_end->next = after_write;
     write = other_end;
 
     // reset other
@@ -143,10 +475,11 @@ void CacheList::Append(CacheList& _other) {
     //      write         read
     auto* before_begin = other_begin->prev;
     auto* after_end = other_end->next;
+    auto* after_write = End()->next;
     End()->next = other_begin;
     other_begin->prev = End();
-    Begin()->prev = other_end;
-    other_end->next = Begin();
+    after_write->prev = other_end;
+    other_end->next = after_write;
     write = other_end;
 
     // chained lists are re-formed into rings
@@ -166,10 +499,13 @@ auto CacheList::FastExpand(std::size_t _size) -> std::int32_t {
   GetNextWrite();
   auto* index = End();
   if (!index->cache) {
-    index->cache.reset(new Cache(Min(round_up(_size), MAX_TO_ALLOC)));
+    index->cache.reset(NewCache(Min(round_up(_size), MAX_TO_ALLOC)));
   }
 
   do {
+    if (!index->cache) {
+      index->cache.reset(NewCache(Min(round_up(_size), MAX_TO_ALLOC)));
+    }
     _size -= Min((*index)->WriteableSize(), _size);
     ++cnt;
     if (index->next == read) {
@@ -181,18 +517,25 @@ auto CacheList::FastExpand(std::size_t _size) -> std::int32_t {
   while (_size > 0) {
     auto alloc_size = Min(round_up(_size), MAX_TO_ALLOC);
     auto* tmp = new Node;
-    tmp->cache.reset(new Cache(alloc_size));
+    tmp->cache.reset(NewCache(alloc_size));
     tmp->prev = index;
     tmp->next = index->next;
     index->next->prev = tmp;
     index->next = tmp;
     index = index->next;
+    _size -= Min(alloc_size, _size);
     ++node_size_;
     ++cnt;
   }
   return cnt;
 }
 
+void CacheList::AddFile(Ucache _file) {
+  HARE_ASSERT(_file && _file->IsFile());
+  GetNextWrite();
+  write->cache = std::move(_file);
+}
+
 // The legality of size is checked before use
 void CacheList::Add(std::size_t _size) {
   auto* index = End();
@@ -218,7 +561,7 @@ void CacheList::Drain(std::size_t _size) {
     _size -= drain_size;
     (*index)->Drain(drain_size);
     if ((*index)->Empty()) {
-      (*index)->Clear();
+      Release(index);
 
       if (index != End()) {
         need_drain = true;
@@ -242,11 +585,15 @@ void CacheList::Drain(std::size_t _size) {
       auto* tmp = Begin()->next;
       tmp->next->prev = Begin();
       Begin()->next = tmp->next;
+      if (tmp == head) {
+        head = index;
+      }
       delete tmp;
       --node_size_;
     }
   }
   read = index;
+  Trim();
 }
 
 void CacheList::Reset() {
@@ -254,16 +601,96 @@ void CacheList::Reset() {
     auto* tmp = head->next;
     tmp->next->prev = head;
     head->next = tmp->next;
+    Release(tmp);
     delete tmp;
   }
-  if (head->cache) {
-    (*head)->Clear();
-  }
+  Release(head);
   node_size_ = 1;
   read = head;
   write = head;
 }
 
+void CacheList::Shrink() {
+  while (write->next != read) {
+    auto* tmp = write->next;
+    write->next = tmp->next;
+    tmp->next->prev = write;
+    if (tmp == head) {
+      head = write;
+    }
+    Free(tmp);
+    delete tmp;
+    --node_size_;
+  }
+  if (Empty()) {
+    Free(write);
+  }
+}
+
+void CacheList::Trim() {
+  if (!Empty()) {
+    empty_rounds = 0;
+  } else if (idle_rounds != 0 && ++empty_rounds >= idle_rounds) {
+    empty_rounds = 0;
+    Shrink();
+    return;
+  }
+  if (max_retained == 0) {
+    return;
+  }
+
+  // keeps the spare blocks next to `End()`, which are written first.
+  std::size_t retained{0};
+  auto* index = write;
+  while (index->next != read) {
+    auto* tmp = index->next;
+    retained += tmp->cache ? (*tmp)->capacity() : 0;
+    if (retained <= max_retained) {
+      index = tmp;
+      continue;
+    }
+    index->next = tmp->next;
+    tmp->next->prev = index;
+    if (tmp == head) {
+      head = index;
+    }
+    Free(tmp);
+    delete tmp;
+    --node_size_;
+  }
+}
+
+void CacheList::Pin(Node* _last) {
+  auto id = zc_next++;
+  auto* index = Begin();
+  do {
+    if (index->cache) {
+      (*index)->Pin(id);
+    }
+    if (index == _last) {
+      break;
+    }
+    index = index->next;
+  } while (index != Begin());
+}
+
+void CacheList::Unpin(std::uint32_t _done) {
+  zc_done = _done;
+  pinned.erase(std::remove_if(pinned.begin(), pinned.end(),
+                              [&](const Ucache& _cache) {
+                                return Completed(_cache->PinId());
+                              }),
+               pinned.end());
+
+  auto* index = Begin();
+  do {
+    if (index->cache && (*index)->Pinned() && Completed((*index)->PinId())) {
+      (*index)->Unpin();
+    }
+    index = index->next;
+  } while (index != Begin());
+}
+
 #ifdef HARE_DEBUG
 void CacheList::PrintStatus(const std::string& _status) const {
   HARE_INTERNAL_TRACE("[{}] list total length: {:}", _status, node_size_);
@@ -273,6 +700,7 @@ void CacheList::PrintStatus(const std::string& _status) const {
     /// | (RW|R|W|E|N) ... | [<-(w_itre|r_iter)]
     const auto* mark =
         !index->cache                                                   ? "(N)"
+        : (*index)->IsFile()                                            ? "(F)"
         : (*index)->ReadableSize() > 0 && (*index)->WriteableSize() > 0 ? "(RW)"
         : (*index)->ReadableSize() > 0                                  ? "(R)"
         : (*index)->WriteableSize() > 0                                 ? "(W)"
@@ -293,31 +721,278 @@ void CacheList::PrintStatus(const std::string& _status) const {
 }
 #endif
 
+#ifdef USE_SPILL_IMPL
+// an unnamed file, which is removed once closed.
+static auto OpenSpill() -> std::int32_t {
+  const auto* tmp_dir = ::getenv("TMPDIR");
+  std::string path{tmp_dir != nullptr && *tmp_dir != '\0' ? tmp_dir : "/tmp"};
+  std::int32_t fd{-1};
+#ifdef O_TMPFILE
+  fd = ::open(path.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+#endif
+  if (fd < 0) {
+    path += "/hare-spill-XXXXXX";
+    fd = ::mkstemp(&path[0]);
+    if (fd >= 0) {
+      IgnoreUnused(::unlink(path.c_str()));
+    }
+  }
+  return fd;
+}
+#endif
+
 }  // namespace detail
 
+auto BufferBudget::Global() -> const Ptr<BufferBudget>& {
+  static Ptr<BufferBudget> global{new BufferBudget(0, nullptr)};
+  return global;
+}
+
+BufferBudget::BufferBudget(std::size_t _limit, Ptr<BufferBudget> _parent)
+    : limit_(_limit), parent_(std::move(_parent)) {}
+
+auto BufferBudget::Exceeded() const -> bool {
+  for (const auto* budget = this; budget != nullptr;
+       budget = budget->parent_.get()) {
+    auto limit = budget->Limit();
+    if (limit != 0 && budget->Usage() > limit) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void BufferBudget::Charge(std::size_t _size) {
+  for (auto* budget = this; budget != nullptr; budget = budget->parent_.get()) {
+    budget->usage_.fetch_add(_size, std::memory_order_relaxed);
+  }
+}
+
+void BufferBudget::Discharge(std::size_t _size) {
+  for (auto* budget = this; budget != nullptr; budget = budget->parent_.get()) {
+    budget->usage_.fetch_sub(_size, std::memory_order_relaxed);
+  }
+}
+
 HARE_IMPL_DEFAULT(Buffer, detail::CacheList cache_chain{};
                   std::size_t total_len{0};
-                  std::size_t max_read{HARE_MAX_READ_DEFAULT};)
+                  std::size_t max_read{HARE_MAX_READ_DEFAULT};
+
+                  // learned by the previous reads.
+                  std::size_t read_hint{HARE_MAX_READ_DEFAULT};
+                  std::uint8_t shrink_cnt{0};
+
+                  // 0 means zero-copy is disabled.
+                  std::size_t zerocopy_threshold{0};
+
+                  // the data added above `spill_threshold` goes to the
+                  // end of the spill file, 0 means disabled.
+                  std::size_t spill_threshold{0};
+                  Ptr<detail::FileHandle> spill{}; std::int64_t spill_end{0};)
+
+#ifdef USE_SPILL_IMPL
+// true if `_size` more bytes should go to the spill file.
+static auto SpillReady(BufferImpl* _impl, std::size_t _size) -> bool {
+  if (_impl->spill_threshold == 0 || _size == 0 ||
+      _impl->total_len < _impl->spill_threshold) {
+    return false;
+  }
+  if (!_impl->spill) {
+    auto fd = detail::OpenSpill();
+    if (fd < 0) {
+      HARE_INTERNAL_ERROR("cannot open the spill file, detail: {}.",
+                          util::ErrnoStr(errno));
+      // keeps the data in memory from now on.
+      _impl->spill_threshold = 0;
+      return false;
+    }
+    _impl->spill = std::make_shared<detail::FileHandle>(fd, true);
+  }
+  return true;
+}
+
+// `_size` bytes were appended to the spill file.
+static void AddSpilled(BufferImpl* _impl, std::size_t _size) {
+  auto& chain = _impl->cache_chain;
+  auto* last = chain.End();
+  if (_impl->total_len > 0 && (!last->cache || (*last)->Empty())) {
+    last = last->prev;
+  }
+  auto* file = _impl->total_len > 0 && last->cache && (*last)->IsFile()
+                   ? DownCast<detail::FileCache*>(last->cache.get())
+                   : nullptr;
+  if (file != nullptr && file->Handle() == _impl->spill &&
+      file->EndOffset() == _impl->spill_end) {
+    file->Extend(_size);
+  } else {
+    chain.AddFile(detail::Ucache(
+        new detail::FileCache(_impl->spill, _impl->spill_end, _size)));
+  }
+  _impl->spill_end += static_cast<std::int64_t>(_size);
+  _impl->total_len += _size;
+}
+
+static auto SpillBytes(BufferImpl* _impl, const char* _bytes,
+                       std::size_t _size) -> std::size_t {
+  std::size_t total{0};
+  while (total < _size) {
+    auto write_n = ::write(_impl->spill->fd, _bytes + total, _size - total);
+    if (write_n < 0 && errno == EINTR) {
+      continue;
+    } else if (write_n <= 0) {
+      break;
+    }
+    total += static_cast<std::size_t>(write_n);
+  }
+  if (total > 0) {
+    AddSpilled(_impl, total);
+  }
+  return total;
+}
+
+// the file is reused from the beginning once nothing refers to it.
+static void RewindSpill(BufferImpl* _impl) {
+  if (_impl->spill_end > 0 && _impl->spill.use_count() == 1 &&
+      ::ftruncate(_impl->spill->fd, 0) == 0 &&
+      ::lseek(_impl->spill->fd, 0, SEEK_SET) == 0) {
+    _impl->spill_end = 0;
+  }
+}
+#endif
 
 Buffer::Buffer(std::size_t _max_read) : impl_(new BufferImpl) {
-  IMPL->max_read = _max_read;
+  SetMaxRead(_max_read);
+  IMPL->cache_chain.max_retained = DEFAULT_MAX_RETAINED;
 }
 
 Buffer::~Buffer() { delete impl_; }
 
 auto Buffer::Size() const -> std::size_t { return IMPL->total_len; }
 
-void Buffer::SetMaxRead(std::size_t _max_read) { IMPL->max_read = _max_read; }
+void Buffer::SetMaxRead(std::size_t _max_read) {
+  IMPL->max_read = _max_read;
+  IMPL->read_hint = Min(Max(_max_read, std::size_t(MIN_READ_HINT)),
+                        std::size_t(MAX_READ_HINT));
+}
 
 auto Buffer::ChainSize() const -> std::size_t {
   return IMPL->cache_chain.Size();
 }
 
+void Buffer::SetBudget(Ptr<BufferBudget> _budget) {
+  IMPL->cache_chain.budget = std::move(_budget);
+}
+
+auto Buffer::Budget() const -> const Ptr<BufferBudget>& {
+  return IMPL->cache_chain.budget ? IMPL->cache_chain.budget
+                                  : BufferBudget::Global();
+}
+
+void Buffer::SetZeroCopy(std::size_t _threshold) {
+#ifdef USE_ZEROCOPY_IMPL
+  IMPL->zerocopy_threshold = _threshold;
+#else
+  IgnoreUnused(_threshold);
+#endif
+}
+
+void Buffer::SetSpill(std::size_t _threshold) {
+#ifdef USE_SPILL_IMPL
+  IMPL->spill_threshold = _threshold;
+#else
+  IgnoreUnused(_threshold);
+#endif
+}
+
+auto Buffer::Spilled() const -> std::size_t {
+  if (!IMPL->spill || IMPL->total_len == 0) {
+    return 0;
+  }
+  std::size_t spilled{0};
+  for (auto* index = IMPL->cache_chain.Begin();; index = index->next) {
+    if (index->cache && (*index)->IsFile() &&
+        DownCast<detail::FileCache*>(index->cache.get())->Handle() ==
+            IMPL->spill) {
+      spilled += (*index)->ReadableSize();
+    }
+    if (index == IMPL->cache_chain.End()) {
+      break;
+    }
+  }
+  return spilled;
+}
+
+auto Buffer::ZeroCopyPending() const -> std::size_t {
+  return IMPL->cache_chain.zc_next - IMPL->cache_chain.zc_done;
+}
+
+auto Buffer::ReapZeroCopy(util_socket_t _fd) -> std::size_t {
+  std::size_t completed{0};
+#ifdef USE_ZEROCOPY_IMPL
+  auto& chain = IMPL->cache_chain;
+  auto done = chain.zc_done;
+
+  /**
+   * @brief The kernel reports completions as the ranges of send ids, which
+   *   are in order for tcp, so only the upper bound is tracked.
+   **/
+  while (done != chain.zc_next) {
+    alignas(struct cmsghdr)
+        std::array<char, CMSG_SPACE(sizeof(struct sock_extended_err)) * 4>
+            control{};
+    struct msghdr msg {};
+    msg.msg_control = control.data();
+    msg.msg_controllen = control.size();
+    if (::recvmsg(_fd, &msg, MSG_ERRQUEUE) < 0) {
+      break;
+    }
+
+    for (auto* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr;
+         cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+      if (!(cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) &&
+          !(cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR)) {
+        continue;
+      }
+      struct sock_extended_err serr {};
+      ::memcpy(&serr, CMSG_DATA(cmsg), sizeof(serr));
+      if (serr.ee_errno != 0 || serr.ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+        continue;
+      }
+      completed += serr.ee_data - serr.ee_info + 1;
+      if (static_cast<std::int32_t>(serr.ee_data + 1 - done) > 0) {
+        done = serr.ee_data + 1;
+      }
+    }
+  }
+
+  if (done != chain.zc_done) {
+    chain.Unpin(done);
+  }
+#else
+  IgnoreUnused(_fd);
+#endif
+  return completed;
+}
+
 void Buffer::ClearAll() {
   IMPL->cache_chain.Reset();
+  IMPL->cache_chain.Trim();
   IMPL->total_len = 0;
 }
 
+void Buffer::SetTrimPolicy(std::size_t _max_retained,
+                           std::uint32_t _idle_rounds) {
+  IMPL->cache_chain.max_retained = _max_retained;
+  IMPL->cache_chain.idle_rounds = _idle_rounds;
+  IMPL->cache_chain.empty_rounds = 0;
+}
+
+void Buffer::SetBlockPool(std::size_t _bytes_per_thread) {
+  detail::pool_limit = _bytes_per_thread;
+}
+
+void Buffer::ShrinkToFit() { IMPL->cache_chain.Shrink(); }
+
 void Buffer::Skip(std::size_t _size) {
   if (_size >= IMPL->total_len) {
     ClearAll();
@@ -336,6 +1011,13 @@ auto Buffer::End() -> Iterator {
       new BufferIteratorImpl(&IMPL->cache_chain, IMPL->cache_chain.End()));
 }
 
+auto Buffer::Cursor() const -> BufferCursor {
+  BufferCursor cursor{};
+  cursor.list_ = &IMPL->cache_chain;
+  cursor.Seek(0);
+  return cursor;
+}
+
 auto Buffer::Find(const char* _begin, std::size_t _size) -> Iterator {
   if (_size > IMPL->total_len) {
     return End();
@@ -362,11 +1044,36 @@ void Buffer::Append(Buffer& _other) {
     return;
   }
 
+#ifdef USE_SPILL_IMPL
+  if (SpillReady(IMPL, d_ptr(_other.impl_)->total_len)) {
+    while (d_ptr(_other.impl_)->total_len > 0) {
+      auto spilled = _other.Write(IMPL->spill->fd);
+      if (spilled <= 0) {
+        break;
+      }
+      AddSpilled(IMPL, hare::detail::ToUnsigned(spilled));
+    }
+    if (d_ptr(_other.impl_)->total_len == 0) {
+      return;
+    }
+  }
+#endif
+
 #ifdef HARE_DEBUG
   IMPL->cache_chain.PrintStatus("before append buffer");
   d_ptr(_other.impl_)->cache_chain.PrintStatus("before append other buffer");
 #endif
 
+  /**
+   * @brief Pinned blocks belong to the send ids of their socket, so the
+   *   content is copied instead of moving blocks between the chains.
+   **/
+  if (IMPL->cache_chain.HasPinned() ||
+      d_ptr(_other.impl_)->cache_chain.HasPinned()) {
+    CopyFrom(_other);
+    return;
+  }
+
   if (IMPL->total_len == 0) {
     IMPL->cache_chain.Swap(d_ptr(_other.impl_)->cache_chain);
   } else {
@@ -387,6 +1094,18 @@ auto Buffer::Add(const void* _bytes, std::size_t _size) -> bool {
     return false;
   }
 
+#ifdef USE_SPILL_IMPL
+  if (SpillReady(IMPL, _size)) {
+    auto spilled = SpillBytes(IMPL, static_cast<const char*>(_bytes), _size);
+    if (spilled == _size) {
+      return true;
+    }
+    // the rest is kept in memory after the spilled part.
+    _bytes = static_cast<const char*>(_bytes) + spilled;
+    _size -= spilled;
+  }
+#endif
+
   IMPL->total_len += _size;
   IMPL->cache_chain.CheckSize(_size);
   IMPL->cache_chain.End()->cache->Append(
@@ -399,46 +1118,274 @@ auto Buffer::Add(const void* _bytes, std::size_t _size) -> bool {
   return true;
 }
 
+auto Buffer::AddFile(std::int32_t _fd, std::int64_t _offset,
+                     std::size_t _length, bool _auto_close) -> bool {
+  if (_fd < 0 || _offset < 0 || IMPL->total_len + _length > MAX_SIZE) {
+    return false;
+  }
+  if (_length == 0) {
+    // keep the promise of closing the file.
+    detail::FileHandle handle(_fd, _auto_close);
+    return true;
+  }
+
+  IMPL->total_len += _length;
+  IMPL->cache_chain.AddFile(detail::Ucache(new detail::FileCache(
+      std::make_shared<detail::FileHandle>(_fd, _auto_close), _offset,
+      _length)));
+
+#ifdef HARE_DEBUG
+  IMPL->cache_chain.PrintStatus("after add file");
+#endif
+  return true;
+}
+
 auto Buffer::Remove(void* _buffer, std::size_t _length) -> std::size_t {
-  using hare::util::detail::MakeChecked;
+  if (_length == 0 || IMPL->total_len == 0) {
+    return 0;
+  }
 
+  auto total = detail::copy_out(IMPL->cache_chain, static_cast<char*>(_buffer),
+                                Min(_length, IMPL->total_len));
+  IMPL->total_len -= total;
+  IMPL->cache_chain.Drain(total);
+
+#ifdef HARE_DEBUG
+  IMPL->cache_chain.PrintStatus("after remove");
+#endif
+  return total;
+}
+
+auto Buffer::Peek(void* _buffer, std::size_t _length) const -> std::size_t {
   if (_length == 0 || IMPL->total_len == 0) {
     return 0;
   }
+  return detail::copy_out(IMPL->cache_chain, static_cast<char*>(_buffer),
+                          Min(_length, IMPL->total_len));
+}
 
-  if (_length > IMPL->total_len) {
-    _length = IMPL->total_len;
+auto Buffer::AddInt8(std::uint8_t _value) -> bool {
+  return Add(&_value, sizeof(_value));
+}
+
+auto Buffer::AddInt16(std::uint16_t _value, Endian _endian) -> bool {
+  return detail::add_int(*this, _value, _endian);
+}
+
+auto Buffer::AddInt32(std::uint32_t _value, Endian _endian) -> bool {
+  return detail::add_int(*this, _value, _endian);
+}
+
+auto Buffer::AddInt64(std::uint64_t _value, Endian _endian) -> bool {
+  return detail::add_int(*this, _value, _endian);
+}
+
+auto Buffer::PeekInt8(std::uint8_t& _value) const -> bool {
+  return detail::peek_int(IMPL->cache_chain, IMPL->total_len, _value,
+                          ENDIAN_BIG);
+}
+
+auto Buffer::PeekInt16(std::uint16_t& _value, Endian _endian) const -> bool {
+  return detail::peek_int(IMPL->cache_chain, IMPL->total_len, _value, _endian);
+}
+
+auto Buffer::PeekInt32(std::uint32_t& _value, Endian _endian) const -> bool {
+  return detail::peek_int(IMPL->cache_chain, IMPL->total_len, _value, _endian);
+}
+
+auto Buffer::PeekInt64(std::uint64_t& _value, Endian _endian) const -> bool {
+  return detail::peek_int(IMPL->cache_chain, IMPL->total_len, _value, _endian);
+}
+
+auto Buffer::ReadInt8(std::uint8_t& _value) -> bool {
+  return PeekInt8(_value) && (Skip(sizeof(_value)), true);
+}
+
+auto Buffer::ReadInt16(std::uint16_t& _value, Endian _endian) -> bool {
+  return PeekInt16(_value, _endian) && (Skip(sizeof(_value)), true);
+}
+
+auto Buffer::ReadInt32(std::uint32_t& _value, Endian _endian) -> bool {
+  return PeekInt32(_value, _endian) && (Skip(sizeof(_value)), true);
+}
+
+auto Buffer::ReadInt64(std::uint64_t& _value, Endian _endian) -> bool {
+  return PeekInt64(_value, _endian) && (Skip(sizeof(_value)), true);
+}
+
+auto Buffer::AddVarint(std::uint64_t _value) -> bool {
+  std::array<std::uint8_t, MAX_VARINT_SIZE> bytes{};
+  std::size_t size{0};
+  while (_value >= 0x80) {
+    bytes[size++] = static_cast<std::uint8_t>(_value | 0x80);
+    _value >>= 7;
   }
+  bytes[size++] = static_cast<std::uint8_t>(_value);
+  return Add(bytes.data(), size);
+}
 
-  auto* curr{IMPL->cache_chain.Begin()};
-  std::size_t total{0};
-  auto* dest = static_cast<char*>(_buffer);
-  while (total < _length) {
-    auto copy_len = Min(_length - total, (*curr)->ReadableSize());
-    std::uninitialized_copy_n(dest + total, copy_len,
-                              MakeChecked((*curr)->Readable(), copy_len));
-    total += copy_len;
-    curr = curr->next;
+auto Buffer::PeekVarint(std::uint64_t& _value) const -> std::int32_t {
+  if (IMPL->total_len == 0) {
+    return 0;
+  }
+  auto* begin = IMPL->cache_chain.Begin();
+  if (!(*begin)->IsFile()) {
+    auto ret = detail::decode_varint(
+        reinterpret_cast<const std::uint8_t*>((*begin)->Readable()),
+        (*begin)->ReadableSize(), _value);
+    if (ret != 0 || (*begin)->ReadableSize() == IMPL->total_len) {
+      return ret;
+    }
   }
 
-  IMPL->total_len -= _length;
-  IMPL->cache_chain.Drain(_length);
+  // the varint crosses the boundary of blocks.
+  std::array<std::uint8_t, MAX_VARINT_SIZE> bytes{};
+  auto size = Peek(bytes.data(), bytes.size());
+  return detail::decode_varint(bytes.data(), size, _value);
+}
 
-#ifdef HARE_DEBUG
-  IMPL->cache_chain.PrintStatus("after remove");
-#endif
-  return _length;
+auto Buffer::ReadVarint(std::uint64_t& _value) -> std::int32_t {
+  auto ret = PeekVarint(_value);
+  if (ret > 0) {
+    Skip(static_cast<std::size_t>(ret));
+  }
+  return ret;
 }
 
-auto Buffer::Read(util_socket_t _fd, std::size_t _howmuch) -> std::size_t {
-  auto readable = socket_op::GetBytesReadableOnSocket(_fd);
-  if (readable == 0) {
-    readable = IMPL->max_read;
+auto Buffer::AddFrame(const void* _bytes, std::size_t _size,
+                      FramePrefix _prefix) -> bool {
+  std::size_t header{0};
+  switch (_prefix) {
+    case FRAME_PREFIX_16:
+      header = _size <= UINT16_MAX ? sizeof(std::uint16_t) : 0;
+      break;
+    case FRAME_PREFIX_32:
+      header = _size <= UINT32_MAX ? sizeof(std::uint32_t) : 0;
+      break;
+    case FRAME_PREFIX_VARINT:
+      header = 1;
+      for (auto value = _size; value >= 0x80; value >>= 7) {
+        ++header;
+      }
+      break;
+    default:
+      break;
   }
-  if (_howmuch == 0 || _howmuch > readable) {
-    _howmuch = readable;
-  } else {
-    readable = _howmuch;
+
+  // a prefix without its payload would corrupt the stream.
+  if (header == 0 || IMPL->total_len + header + _size > MAX_SIZE) {
+    return false;
+  }
+  switch (_prefix) {
+    case FRAME_PREFIX_16:
+      AddInt16(static_cast<std::uint16_t>(_size), ENDIAN_BIG);
+      break;
+    case FRAME_PREFIX_32:
+      AddInt32(static_cast<std::uint32_t>(_size), ENDIAN_BIG);
+      break;
+    default:
+      AddVarint(_size);
+      break;
+  }
+  return Add(_bytes, _size);
+}
+
+auto Buffer::PeekFrame(std::size_t& _header, std::size_t& _length,
+                       FramePrefix _prefix) const -> std::int32_t {
+  std::int32_t ret{0};
+  switch (_prefix) {
+    case FRAME_PREFIX_16: {
+      std::uint16_t length{};
+      if (PeekInt16(length, ENDIAN_BIG)) {
+        _header = sizeof(length);
+        _length = length;
+        ret = 1;
+      }
+      break;
+    }
+    case FRAME_PREFIX_32: {
+      std::uint32_t length{};
+      if (PeekInt32(length, ENDIAN_BIG)) {
+        _header = sizeof(length);
+        _length = length;
+        ret = 1;
+      }
+      break;
+    }
+    case FRAME_PREFIX_VARINT: {
+      std::uint64_t length{};
+      ret = PeekVarint(length);
+      if (ret > 0) {
+        _header = static_cast<std::size_t>(ret);
+        _length = static_cast<std::size_t>(length);
+        ret = length > MAX_SIZE ? -1 : 1;
+      }
+      break;
+    }
+    default:
+      ret = -1;
+      break;
+  }
+
+  if (ret > 0 && _header + _length > IMPL->total_len) {
+    ret = 0;
+  }
+  return ret;
+}
+
+auto Buffer::ReadFrame(Buffer& _frame, FramePrefix _prefix) -> std::int32_t {
+  std::size_t header{0};
+  std::size_t length{0};
+  if (&_frame == this) {
+    return -1;
+  }
+  auto ret = PeekFrame(header, length, _prefix);
+  if (ret <= 0) {
+    return ret;
+  }
+
+  Skip(header);
+  if (length == IMPL->total_len) {
+    // the frame is the rest of buffer, so the blocks are moved.
+    _frame.Append(*this);
+    return ret;
+  }
+
+  auto* frame = d_ptr(_frame.impl_);
+  auto remain = length;
+  auto* curr = IMPL->cache_chain.Begin();
+  while (remain > 0) {
+    auto size = Min(remain, (*curr)->ReadableSize());
+    if ((*curr)->IsFile()) {
+      const auto* file = DownCast<detail::FileCache*>(curr->cache.get());
+      frame->cache_chain.AddFile(detail::Ucache(
+          new detail::FileCache(file->Handle(), file->Offset(), size)));
+      frame->total_len += size;
+    } else {
+      _frame.Add((*curr)->Readable(), size);
+    }
+    remain -= size;
+    curr = curr->next;
+  }
+  Skip(length);
+  return ret;
+}
+
+auto Buffer::Read(util_socket_t _fd, std::size_t _howmuch) -> std::int64_t {
+  return ReadV(_fd, _howmuch, nullptr);
+}
+
+auto Buffer::Read(util_socket_t _fd, Timestamp& _kernel_time,
+                  std::size_t _howmuch) -> std::int64_t {
+  _kernel_time = Timestamp();
+  return ReadV(_fd, _howmuch, &_kernel_time);
+}
+
+auto Buffer::ReadV(util_socket_t _fd, std::size_t _howmuch,
+                   Timestamp* _kernel_time) -> std::int64_t {
+  auto expected = IMPL->read_hint;
+  if (_howmuch != 0 && _howmuch < expected) {
+    expected = _howmuch;
   }
 
 #ifdef HARE_DEBUG
@@ -446,45 +1393,81 @@ auto Buffer::Read(util_socket_t _fd, std::size_t _howmuch) -> std::size_t {
 #endif
 
 #ifdef USE_IOVEC_IMPL
-  auto block_size = IMPL->cache_chain.FastExpand(readable);
-  std::vector<IOV_TYPE> vecs(block_size);
+  static thread_local std::array<char, READ_SPILL_SIZE> spill{};
+  std::array<IOV_TYPE, NUM_WRITE_IOVEC> vecs{};
+  std::size_t chain_size{0};
+
+  auto block_size = Min(IMPL->cache_chain.FastExpand(expected),
+                        static_cast<std::int32_t>(NUM_WRITE_IOVEC - 1));
   auto* block = IMPL->cache_chain.End();
 
   for (auto i = 0; i < block_size; ++i, block = block->next) {
     vecs[i].IOV_PTR_FIELD = (*block)->Writeable();
-    vecs[i].IOV_LEN_FIELD = (*block)->WriteableSize();
+    vecs[i].IOV_LEN_FIELD =
+        static_cast<IOV_LEN_TYPE>((*block)->WriteableSize());
+    chain_size += (*block)->WriteableSize();
   }
 
-  {
-    std::int64_t actual{};
+  auto iov_cnt = block_size;
+  if (_howmuch == 0 || _howmuch > chain_size) {
+    vecs[iov_cnt].IOV_PTR_FIELD = spill.data();
+    vecs[iov_cnt++].IOV_LEN_FIELD = static_cast<IOV_LEN_TYPE>(
+        _howmuch == 0 ? spill.size() : Min(_howmuch - chain_size, spill.size()));
+  }
+
+  std::int64_t actual{};
 #ifdef H_OS_WIN
-    {
-      DWORD bytes_read{};
-      DWORD flags{0};
-      if (::WSARecv(_fd, vecs.data(), block_size, &bytes_read, &flags, nullptr,
-                    nullptr) != 0) {
-        /* The read failed. It might be a close,
-         * or it might be an error. */
-        if (::WSAGetLastError() == WSAECONNABORTED) {
-          actual = 0;
-        } else {
-          actual = -1;
-        }
+  {
+    DWORD bytes_read{};
+    DWORD flags{0};
+    if (::WSARecv(_fd, vecs.data(), iov_cnt, &bytes_read, &flags, nullptr,
+                  nullptr) != 0) {
+      /* The read failed. It might be a close,
+       * or it might be an error. */
+      if (::WSAGetLastError() == WSAECONNABORTED) {
+        actual = 0;
       } else {
-        readable = bytes_read;
+        actual = -1;
       }
+    } else {
+      actual = bytes_read;
     }
+  }
+#elif defined(USE_RX_TIMESTAMP_IMPL)
+  if (_kernel_time != nullptr) {
+    actual = detail::read_stamped(_fd, vecs.data(), iov_cnt, *_kernel_time);
+  } else {
+    actual = ::readv(_fd, vecs.data(), iov_cnt);
+  }
 #else
-    actual = ::readv(_fd, vecs.data(), block_size);
-    readable = actual > 0 ? actual : 0;
+  IgnoreUnused(_kernel_time);
+  actual = ::readv(_fd, vecs.data(), iov_cnt);
 #endif
-    if (actual <= 0) {
-      return (0);
-    }
+  if (actual <= 0) {
+    return actual;
   }
 
-  IMPL->cache_chain.Add(readable);
-  IMPL->total_len += readable;
+  auto read_n = hare::detail::ToUnsigned(actual);
+  auto in_chain = Min(read_n, chain_size);
+  IMPL->cache_chain.Add(in_chain);
+  IMPL->total_len += in_chain;
+  if (read_n > in_chain) {
+    Add(spill.data(), read_n - in_chain);
+  }
+
+  /**
+   * @brief Grow as soon as the expected size is filled, shrink only after
+   *   twice in a row read less than half of it.
+   **/
+  if (read_n >= expected) {
+    IMPL->read_hint = Min(IMPL->read_hint << 1, std::size_t(MAX_READ_HINT));
+    IMPL->shrink_cnt = 0;
+  } else if (read_n >= (IMPL->read_hint >> 1)) {
+    IMPL->shrink_cnt = 0;
+  } else if (++IMPL->shrink_cnt >= 2) {
+    IMPL->read_hint = Max(IMPL->read_hint >> 1, std::size_t(MIN_READ_HINT));
+    IMPL->shrink_cnt = 0;
+  }
 
 #else
 #error "cannot use IOVEC."
@@ -494,11 +1477,11 @@ auto Buffer::Read(util_socket_t _fd, std::size_t _howmuch) -> std::size_t {
   IMPL->cache_chain.PrintStatus("after read");
 #endif
 
-  return readable;
+  return actual;
 }
 
-auto Buffer::Write(util_socket_t _fd, std::size_t _howmuch) -> std::size_t {
-  std::size_t write_n{};
+auto Buffer::Write(util_socket_t _fd, std::size_t _howmuch) -> std::int64_t {
+  std::int64_t write_n{};
   auto total = _howmuch == 0 ? IMPL->total_len : _howmuch;
 
   if (total > IMPL->total_len) {
@@ -510,52 +1493,109 @@ auto Buffer::Write(util_socket_t _fd, std::size_t _howmuch) -> std::size_t {
 #endif
 
 #ifdef USE_IOVEC_IMPL
-  std::array<IOV_TYPE, NUM_WRITE_IOVEC> iov{};
-  auto* curr{IMPL->cache_chain.Begin()};
-  auto write_i{0};
-
-  while (write_i < NUM_WRITE_IOVEC && total > 0) {
-    iov[write_i].IOV_PTR_FIELD = (*curr)->Readable();
-    if (total > (*curr)->ReadableSize()) {
-      /* XXXcould be problematic when windows supports mmap*/
-      iov[write_i++].IOV_LEN_FIELD =
-          static_cast<IOV_LEN_TYPE>((*curr)->ReadableSize());
-      total -= (*curr)->ReadableSize();
-      curr = curr->next;
+  /**
+   * @brief Memory blocks are gathered into one iovec until a file segment
+   *   is met, file segments are sent by sendfile(2). Stop when the socket
+   *   cannot accept more.
+   **/
+  while (total > 0) {
+    std::int64_t actual{};
+    std::size_t expected{};
+    auto* curr{IMPL->cache_chain.Begin()};
+
+    if ((*curr)->IsFile()) {
+      expected = Min(total, (*curr)->ReadableSize());
+      actual = detail::send_file(
+          _fd, *DownCast<detail::FileCache*>(curr->cache.get()), expected);
+      if (actual == 0) {
+        /**
+         * @brief The file is shorter than the segment, it would never be
+         *   drained, so the segment is dropped and the stream is broken.
+         **/
+        HARE_INTERNAL_ERROR("file segment of buffer is truncated.");
+        auto dropped = (*curr)->ReadableSize();
+        IMPL->total_len -= dropped;
+        IMPL->cache_chain.Drain(dropped);
+        errno = EIO;
+        write_n = -1;
+        break;
+      }
     } else {
-      /* XXXcould be problematic when windows supports mmap*/
-      iov[write_i++].IOV_LEN_FIELD = static_cast<IOV_LEN_TYPE>(total);
-      total = 0;
-    }
-  }
-
-  if (write_i == 0) {
-    return (0);
-  }
+      std::array<IOV_TYPE, NUM_WRITE_IOVEC> iov{};
+      auto write_i{0};
+      auto remain = total;
+      auto* last{curr};
+
+      while (write_i < NUM_WRITE_IOVEC && remain > 0 && !(*curr)->IsFile()) {
+        iov[write_i].IOV_PTR_FIELD = (*curr)->Readable();
+        last = curr;
+        if (remain > (*curr)->ReadableSize()) {
+          /* XXXcould be problematic when windows supports mmap*/
+          iov[write_i++].IOV_LEN_FIELD =
+              static_cast<IOV_LEN_TYPE>((*curr)->ReadableSize());
+          remain -= (*curr)->ReadableSize();
+          curr = curr->next;
+        } else {
+          /* XXXcould be problematic when windows supports mmap*/
+          iov[write_i++].IOV_LEN_FIELD = static_cast<IOV_LEN_TYPE>(remain);
+          remain = 0;
+        }
+      }
+      expected = total - remain;
 
-  {
-    std::int64_t actual{};
 #ifdef H_OS_WIN
-    {
-      DWORD bytes_sent{};
-      if (::WSASend(_fd, iov.data(), write_i, &bytes_sent, 0, nullptr,
-                    nullptr)) {
-        actual = -1;
-      } else {
-        write_n = bytes_sent;
+      {
+        DWORD bytes_sent{};
+        if (::WSASend(_fd, iov.data(), write_i, &bytes_sent, 0, nullptr,
+                      nullptr)) {
+          actual = -1;
+        } else {
+          actual = bytes_sent;
+        }
       }
-    }
 #else
-    actual = ::writev(_fd, iov.data(), write_i);
-    write_n = actual > 0 ? actual : 0;
+      auto use_writev{true};
+#ifdef USE_ZEROCOPY_IMPL
+      /**
+       * @brief The blocks are pinned until the kernel completes the send,
+       *   falls back to writev(2) if the kernel has no room to track it.
+       *   Other errors are reported like those of writev(2).
+       **/
+      if (IMPL->zerocopy_threshold != 0 &&
+          expected >= IMPL->zerocopy_threshold) {
+        struct msghdr msg {};
+        msg.msg_iov = iov.data();
+        msg.msg_iovlen = static_cast<std::size_t>(write_i);
+        actual = ::sendmsg(_fd, &msg, MSG_ZEROCOPY);
+        if (actual > 0) {
+          IMPL->cache_chain.Pin(last);
+        }
+        use_writev = actual < 0 && errno == ENOBUFS;
+      }
+#endif
+      if (use_writev) {
+        actual = ::writev(_fd, iov.data(), write_i);
+      }
 #endif
-    if (actual <= 0) {
-      return (0);
     }
-  }
 
-  IMPL->total_len -= write_n;
-  IMPL->cache_chain.Drain(write_n);
+    if (actual < 0) {
+      if (write_n == 0) {
+        write_n = -1;
+      }
+      break;
+    }
+
+    auto written = hare::detail::ToUnsigned(actual);
+    write_n += actual;
+    total -= written;
+    IMPL->total_len -= written;
+    IMPL->cache_chain.Drain(written);
+
+    if (written < expected) {
+      break;
+    }
+  }
 
 #else
 #error "cannot use IOVEC."
@@ -565,13 +1605,51 @@ auto Buffer::Write(util_socket_t _fd, std::size_t _howmuch) -> std::size_t {
   IMPL->cache_chain.PrintStatus("after write");
 #endif
 
+#ifdef USE_SPILL_IMPL
+  if (IMPL->total_len == 0) {
+    RewindSpill(IMPL);
+  }
+#endif
   return write_n;
 }
 
+void Buffer::CopyFrom(Buffer& _other) {
+  auto* other = d_ptr(_other.impl_);
+  auto* index = other->cache_chain.Begin();
+  auto remain = other->total_len;
+  while (remain > 0) {
+    auto size = Min(remain, (*index)->ReadableSize());
+    if ((*index)->IsFile()) {
+      auto* file = DownCast<detail::FileCache*>(index->cache.get());
+      IMPL->cache_chain.AddFile(detail::Ucache(
+          new detail::FileCache(file->Handle(), file->Offset(), size)));
+      IMPL->total_len += size;
+    } else {
+      Add((*index)->Readable(), size);
+    }
+    remain -= size;
+    index = index->next;
+  }
+  other->cache_chain.Drain(other->total_len);
+  other->total_len = 0;
+}
+
 void Buffer::Move(Buffer& _other) noexcept {
   IMPL->cache_chain.Swap(d_ptr(_other.impl_)->cache_chain);
   std::swap(IMPL->total_len, d_ptr(_other.impl_)->total_len);
   std::swap(IMPL->max_read, d_ptr(_other.impl_)->max_read);
+  std::swap(IMPL->read_hint, d_ptr(_other.impl_)->read_hint);
+  std::swap(IMPL->shrink_cnt, d_ptr(_other.impl_)->shrink_cnt);
+  std::swap(IMPL->zerocopy_threshold, d_ptr(_other.impl_)->zerocopy_threshold);
+  std::swap(IMPL->spill_threshold, d_ptr(_other.impl_)->spill_threshold);
+  std::swap(IMPL->spill, d_ptr(_other.impl_)->spill);
+  std::swap(IMPL->spill_end, d_ptr(_other.impl_)->spill_end);
+  std::swap(IMPL->cache_chain.pinned, d_ptr(_other.impl_)->cache_chain.pinned);
+  std::swap(IMPL->cache_chain.zc_next,
+            d_ptr(_other.impl_)->cache_chain.zc_next);
+  std::swap(IMPL->cache_chain.zc_done,
+            d_ptr(_other.impl_)->cache_chain.zc_done);
+  std::swap(IMPL->cache_chain.budget, d_ptr(_other.impl_)->cache_chain.budget);
 }
 
 }  // namespace net
@@ -7,7 +7,9 @@ namespace net {
 HARE_IMPL_DPTR(BufferIterator);
 
 auto BufferIterator::operator*() noexcept -> char {
-  return Valid() ? (*IMPL->iter)->Data()[IMPL->curr_index] : '\0';
+  return Valid() && !(*IMPL->iter)->IsFile()
+             ? (*IMPL->iter)->Data()[IMPL->curr_index]
+             : '\0';
 }
 
 auto BufferIterator::operator++() noexcept -> BufferIterator& {
@@ -62,5 +64,69 @@ auto operator!=(const BufferIterator& _x, const BufferIterator& _y) noexcept
          d_ptr(_x.impl_)->curr_index != d_ptr(_y.impl_)->curr_index;
 }
 
+namespace detail {
+static HARE_INLINE auto memory_node(const CacheList::Node* _node) -> bool {
+  return _node->cache && !_node->cache->IsFile();
+}
+}  // namespace detail
+
+auto BufferCursor::NextSegment() -> bool {
+  const auto* list = static_cast<const detail::CacheList*>(list_);
+  auto* node = static_cast<detail::CacheList::Node*>(const_cast<void*>(node_));
+  base_ += static_cast<std::size_t>(end_ - begin_);
+
+  while (node != nullptr && node != list->End()) {
+    node = node->next;
+    if (!detail::memory_node(node)) {
+      break;
+    }
+    if (!(*node)->Empty()) {
+      node_ = node;
+      begin_ = ptr_ = (*node)->Readable();
+      end_ = begin_ + (*node)->ReadableSize();
+      return true;
+    }
+  }
+  SetEnd();
+  return false;
+}
+
+auto BufferCursor::Seek(std::size_t _offset) -> bool {
+  const auto* list = static_cast<const detail::CacheList*>(list_);
+  auto* node = list->Begin();
+  std::size_t base{0};
+
+  while (detail::memory_node(node)) {
+    auto size = (*node)->ReadableSize();
+    if (_offset < base + size) {
+      node_ = node;
+      base_ = base;
+      begin_ = (*node)->Readable();
+      ptr_ = begin_ + (_offset - base);
+      end_ = begin_ + size;
+      return true;
+    }
+    base += size;
+    if (node == list->End()) {
+      break;
+    }
+    node = node->next;
+  }
+
+  node_ = nullptr;
+  base_ = base;
+  SetEnd();
+  return _offset == base;
+}
+
+auto BufferCursor::At(std::size_t _offset) const -> char {
+  auto cursor = *this;
+  return cursor.Seek(_offset) && cursor.Valid() ? *cursor : '\0';
+}
+
+void BufferCursor::SetEnd() {
+  begin_ = ptr_ = end_ = nullptr;
+}
+
 }  // namespace net
-}  // namespace hare
\ No newline at end of file
+}  // namespace hare
@@ -30,6 +30,12 @@ static std::array<const char*, ERRORS_NBR + 1> error_description{
     "Session already disconnected.",  // ERROR_SESSION_ALREADY_DISCONNECT
     "Failed to get pair socket.",     // ERROR_GET_SOCKET_PAIR
     "Failed to init io pool.",        // ERROR_INIT_IO_POOL
+
+    // Socket options
+    "Failed to set zero copy to socket.",          // ERROR_SOCKET_ZERO_COPY
+    "Failed to set cork to tcp socket.",           // ERROR_SOCKET_TCP_CORK
+    "Failed to set notsent lowat to socket.",      // ERROR_SOCKET_NOTSENT_LOWAT
+    "Failed to set receive timestamp to socket.",  // ERROR_SOCKET_TIMESTAMP
 };
 
 }  // namespace detail
@@ -4,9 +4,13 @@
 #include <hare/base/io/cycle.h>
 #include <hare/base/util/count_down_latch.h>
 #include <hare/base/util/system.h>
+#include <hare/net/buffer.h>
+#include <hare/net/tcp/serve.h>
 
-#include <map>
+#include <atomic>
+#include <random>
 #include <thread>
+#include <unordered_map>
 #include <vector>
 
 #include "base/fwd-inl.h"
@@ -18,7 +22,24 @@ template <typename T>
 struct PoolItem {
   Ptr<io::Cycle> cycle{};
   Ptr<std::thread> thread{};
-  std::map<util_socket_t, T> sessions{};
+  std::unordered_map<util_socket_t, T> sessions{};
+
+  // charged by the buffers of sessions in this item.
+  Ptr<BufferBudget> budget{std::make_shared<BufferBudget>()};
+
+  // live counters for placement, `connections` counts the sessions being
+  // dispatched as well.
+  std::atomic<std::int32_t> connections{0};
+  std::atomic<std::uint64_t> window_bytes{0};
+  std::atomic<std::uint64_t> last_window_bytes{0};
+
+  // the CPU which the worker is pinned to, -1 if not pinned.
+  std::int32_t cpu{-1};
+
+  HARE_INLINE auto Bytes() const -> std::uint64_t {
+    return last_window_bytes.load(std::memory_order_relaxed) +
+           window_bytes.load(std::memory_order_relaxed);
+  }
 };
 
 template <typename T>
@@ -29,8 +50,10 @@ class IOPool : public util::NonCopyable {
   std::int32_t last_{0};
   std::int32_t thread_nbr_{0};
   bool is_running_{false};
+  std::atomic<bool> stopping_{false};
 
   PoolItems items_{};
+  std::minstd_rand random_{std::random_device{}()};
 
  public:
   explicit IOPool(std::string _name) : name_(std::move(_name)) {}
@@ -39,8 +62,14 @@ class IOPool : public util::NonCopyable {
 
   HARE_INLINE auto name() const -> const std::string& { return name_; }
   HARE_INLINE auto is_running() const -> bool { return is_running_; }
+  HARE_INLINE auto stopping() const -> bool { return stopping_; }
+  HARE_INLINE auto items() const -> const PoolItems& { return items_; }
 
-  auto Start(io::Cycle::REACTOR_TYPE _type, std::int32_t _thread_nbr) -> bool;
+  /**
+   * @brief With `_pin_cpu`, worker i is pinned to CPU i (mod CPUs).
+   **/
+  auto Start(io::Cycle::REACTOR_TYPE _type, std::int32_t _thread_nbr,
+             bool _pin_cpu = false) -> bool;
   void Stop();
 
   /**
@@ -48,6 +77,24 @@ class IOPool : public util::NonCopyable {
    *   round-robin
    */
   auto GetNextItem() -> Ptr<PoolItem<T>>;
+  auto GetNextIndex() -> std::size_t;
+
+  /**
+   * @brief Picks a worker by the live counters of items, the round-robin
+   *   index is used to break ties.
+   **/
+  auto GetIndexByPolicy(PlacementPolicy _policy) -> std::size_t;
+
+  /**
+   * @brief Starts a new window of bytes counters.
+   **/
+  void RotateWindow();
+
+  /**
+   * @brief The worker pinned to `_cpu`, or the nearest one. Round robin
+   *   if `_cpu` is unknown or workers are not pinned.
+   **/
+  auto GetIndexByCpu(std::int32_t _cpu) -> std::size_t;
 
   /**
    * @brief With the same hash code, it will always return the same EventLoop
@@ -56,8 +103,8 @@ class IOPool : public util::NonCopyable {
 };
 
 template <typename T>
-auto IOPool<T>::Start(io::Cycle::REACTOR_TYPE _type, std::int32_t _thread_nbr)
-    -> bool {
+auto IOPool<T>::Start(io::Cycle::REACTOR_TYPE _type, std::int32_t _thread_nbr,
+                      bool _pin_cpu) -> bool {
   if (_thread_nbr == 0 || is_running()) {
     return false;
   }
@@ -65,15 +112,23 @@ auto IOPool<T>::Start(io::Cycle::REACTOR_TYPE _type, std::int32_t _thread_nbr)
   items_.resize(_thread_nbr);
 
   HARE_INTERNAL_TRACE("start IO Pool.");
+  // the cycles must exist before any session is dispatched to them.
+  util::CountDownLatch cdl{static_cast<std::uint32_t>(_thread_nbr)};
+  auto cpus = static_cast<std::int32_t>(std::thread::hardware_concurrency());
   for (auto i = 0; i < _thread_nbr; ++i) {
     items_[i] = std::make_shared<PoolItem<T>>();
-    items_[i]->thread = std::make_shared<std::thread>([=] {
+    items_[i]->thread = std::make_shared<std::thread>([=, &cdl] {
       util::SetCurrentThreadName((name_ + std::to_string(i)).c_str());
+      if (_pin_cpu && cpus > 0 && util::SetCurrentThreadAffinity(i % cpus)) {
+        items_[i]->cpu = i % cpus;
+      }
       items_[i]->cycle = std::make_shared<io::Cycle>(_type);
+      cdl.CountDown();
       items_[i]->cycle->Exec();
       items_[i]->cycle.reset();
     });
   }
+  cdl.Await();
 
   is_running_ = true;
   thread_nbr_ = _thread_nbr;
@@ -83,9 +138,23 @@ auto IOPool<T>::Start(io::Cycle::REACTOR_TYPE _type, std::int32_t _thread_nbr)
 template <typename T>
 void IOPool<T>::Stop() {
   HARE_INTERNAL_TRACE("stop io_pool.");
+  stopping_ = true;
+  /**
+   * @brief No more migrations are started once `stopping_` is set. After
+   *   every worker passes the barrier, the migrations in flight have been
+   *   queued to their targets, so they are attached before being closed.
+   **/
+  util::CountDownLatch barrier{static_cast<std::uint32_t>(items_.size())};
+  for (auto& item : items_) {
+    item->cycle->RunInCycle([&barrier] { barrier.CountDown(); });
+  }
+  barrier.Await();
+
   for (auto& item : items_) {
     item->cycle->RunInCycle([=]() mutable {
-      for (const auto& session : item->sessions) {
+      // closing a session erases it from `sessions`.
+      auto sessions = item->sessions;
+      for (const auto& session : sessions) {
         session.second->ForceClose();
       }
       item->sessions.clear();
@@ -97,6 +166,7 @@ void IOPool<T>::Stop() {
     item->thread->join();
   }
   is_running_ = false;
+  stopping_ = false;
   thread_nbr_ = 0;
   items_.clear();
 }
@@ -107,9 +177,78 @@ auto IOPool<T>::GetNextItem() -> Ptr<PoolItem<T>> {
     return {};
   }
 
+  return items_[GetNextIndex()];
+}
+
+template <typename T>
+auto IOPool<T>::GetNextIndex() -> std::size_t {
   auto index = last_++;
   last_ %= thread_nbr_;
-  return items_[index];
+  return static_cast<std::size_t>(index);
+}
+
+template <typename T>
+auto IOPool<T>::GetIndexByPolicy(PlacementPolicy _policy) -> std::size_t {
+  auto next = GetNextIndex();
+  auto size = items_.size();
+  switch (_policy) {
+    case PLACEMENT_LEAST_CONNECTIONS:
+    case PLACEMENT_LEAST_BYTES: {
+      auto least = next;
+      for (std::size_t i = 1; i < size; ++i) {
+        auto index = (next + i) % size;
+        const auto& item = items_[index];
+        auto less = _policy == PLACEMENT_LEAST_CONNECTIONS
+                        ? item->connections < items_[least]->connections
+                        : item->Bytes() < items_[least]->Bytes();
+        if (less) {
+          least = index;
+        }
+      }
+      return least;
+    }
+    case PLACEMENT_POWER_OF_TWO: {
+      if (size < 2) {
+        return next;
+      }
+      auto other = (next + 1 + random_() % (size - 1)) % size;
+      return items_[other]->connections < items_[next]->connections ? other
+                                                                    : next;
+    }
+    case PLACEMENT_ROUND_ROBIN:
+    default:
+      return next;
+  }
+}
+
+template <typename T>
+void IOPool<T>::RotateWindow() {
+  for (auto& item : items_) {
+    item->last_window_bytes.store(
+        item->window_bytes.exchange(0, std::memory_order_relaxed),
+        std::memory_order_relaxed);
+  }
+}
+
+template <typename T>
+auto IOPool<T>::GetIndexByCpu(std::int32_t _cpu) -> std::size_t {
+  auto nearest = GetNextIndex();
+  if (_cpu < 0) {
+    return nearest;
+  }
+  auto distance{-1};
+  for (std::size_t i = 0; i < items_.size(); ++i) {
+    if (items_[i]->cpu < 0) {
+      continue;
+    }
+    auto diff = items_[i]->cpu > _cpu ? items_[i]->cpu - _cpu
+                                      : _cpu - items_[i]->cpu;
+    if (distance < 0 || diff < distance) {
+      distance = diff;
+      nearest = i;
+    }
+  }
+  return nearest;
 }
 
 template <typename T>
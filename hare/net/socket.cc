@@ -13,6 +13,14 @@
 #include <netinet/tcp.h>
 #endif
 
+#if HARE__HAVE_SYS_IOCTL_H
+#include <sys/ioctl.h>
+#endif
+
+#if HARE__HAVE_LINUX_SOCKIOS_H
+#include <linux/sockios.h>
+#endif
+
 #if defined(H_OS_WIN)
 #include <WinSock2.h>
 #include <Ws2tcpip.h>
@@ -59,15 +67,9 @@ auto Socket::Close() -> Error {
 }
 
 auto Socket::Accept(HostAddress& _peer_addr) const -> util_socket_t {
-  struct sockaddr_in6 addr {};
-  hare::detail::FillN(&addr, sizeof(addr), 0);
-  auto accept_fd = socket_op::Accept(socket_, socket_op::SockaddrCast(&addr),
-                                     socket_op::AddrLen(PF_INET6));
-  if (accept_fd >= 0) {
-    HARE_ASSERT(_peer_addr.in_ != nullptr);
-    std::memcpy(_peer_addr.in_, &addr, sizeof(struct sockaddr_in6));
-  }
-  return accept_fd;
+  // the peer address is written into its inline storage directly.
+  return socket_op::Accept(socket_, _peer_addr.get_sockaddr(),
+                           socket_op::AddrLen(PF_INET6));
 }
 
 auto Socket::ShutdownWrite() const -> Error {
@@ -82,11 +84,27 @@ auto Socket::ShutdownWrite() const -> Error {
 
 auto Socket::SetTcpNoDelay(bool _no_delay) const -> Error {
   auto opt_val = _no_delay ? 1 : 0;
-  auto ret = ::setsockopt(socket_, SOL_SOCKET, TCP_NODELAY, (char*)&opt_val,
+  auto ret = ::setsockopt(socket_, IPPROTO_TCP, TCP_NODELAY, (char*)&opt_val,
                           static_cast<socklen_t>(sizeof(opt_val)));
   return ret != 0 ? Error(ERROR_SOCKET_TCP_NO_DELAY) : Error();
 }
 
+auto Socket::SetTcpCork(bool _cork) const -> Error {
+#ifdef TCP_CORK
+  auto opt_val = _cork ? 1 : 0;
+  auto ret = ::setsockopt(socket_, IPPROTO_TCP, TCP_CORK, &opt_val,
+                          static_cast<socklen_t>(sizeof(opt_val)));
+#elif defined(TCP_NOPUSH)
+  auto opt_val = _cork ? 1 : 0;
+  auto ret = ::setsockopt(socket_, IPPROTO_TCP, TCP_NOPUSH, &opt_val,
+                          static_cast<socklen_t>(sizeof(opt_val)));
+#else
+  IgnoreUnused(_cork);
+  auto ret = -1;
+#endif
+  return ret != 0 ? Error(ERROR_SOCKET_TCP_CORK) : Error();
+}
+
 auto Socket::SetReuseAddr(bool _reuse) const -> Error {
   auto optval = _reuse ? 1 : 0;
   auto ret = ::setsockopt(socket_, SOL_SOCKET, SO_REUSEADDR, (char*)&optval,
@@ -121,5 +139,79 @@ auto Socket::SetKeepAlive(bool _keep_alive) const -> Error {
   return ret != 0 ? Error(ERROR_SOCKET_KEEP_ALIVE) : Error();
 }
 
+auto Socket::SetZeroCopy(bool _zero_copy) const -> Error {
+#ifdef SO_ZEROCOPY
+  auto optval = _zero_copy ? 1 : 0;
+  auto ret = ::setsockopt(socket_, SOL_SOCKET, SO_ZEROCOPY, &optval,
+                          static_cast<socklen_t>(sizeof(optval)));
+  return ret != 0 ? Error(ERROR_SOCKET_ZERO_COPY) : Error();
+#else
+  IgnoreUnused(_zero_copy);
+  return Error(ERROR_SOCKET_ZERO_COPY);
+#endif
+}
+
+auto Socket::SetNotSentLowat(std::uint32_t _bytes) const -> Error {
+#ifdef TCP_NOTSENT_LOWAT
+  // 0 falls back to the sysctl net.ipv4.tcp_notsent_lowat.
+  auto opt_val = _bytes;
+  auto ret = ::setsockopt(socket_, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &opt_val,
+                          static_cast<socklen_t>(sizeof(opt_val)));
+  return ret != 0 ? Error(ERROR_SOCKET_NOTSENT_LOWAT) : Error();
+#else
+  IgnoreUnused(_bytes);
+  return Error(ERROR_SOCKET_NOTSENT_LOWAT);
+#endif
+}
+
+auto Socket::SetRecvTimestamp(bool _enable) const -> Error {
+#ifdef SO_TIMESTAMPNS
+  std::int32_t opt_val = _enable ? 1 : 0;
+  auto ret = ::setsockopt(socket_, SOL_SOCKET, SO_TIMESTAMPNS, &opt_val,
+                          static_cast<socklen_t>(sizeof(opt_val)));
+  return ret != 0 ? Error(ERROR_SOCKET_TIMESTAMP) : Error();
+#else
+  IgnoreUnused(_enable);
+  return Error(ERROR_SOCKET_TIMESTAMP);
+#endif
+}
+
+auto Socket::KernelQueued() const -> std::int64_t {
+#if HARE__HAVE_SYS_IOCTL_H && defined(SIOCOUTQ)
+  std::int32_t queued{0};
+  return ::ioctl(socket_, SIOCOUTQ, &queued) == 0 ? queued : -1;
+#else
+  return -1;
+#endif
+}
+
+auto Socket::KernelUnsent() const -> std::int64_t {
+#if HARE__HAVE_SYS_IOCTL_H && defined(SIOCOUTQNSD)
+  std::int32_t unsent{0};
+  return ::ioctl(socket_, SIOCOUTQNSD, &unsent) == 0 ? unsent : -1;
+#else
+  return -1;
+#endif
+}
+
+auto Socket::GetTcpInfo(TcpInfo& _info) const -> bool {
+#if HARE__HAVE_NETINET_TCP_H && defined(TCP_INFO)
+  struct tcp_info info {};
+  auto length = static_cast<socklen_t>(sizeof(info));
+  if (::getsockopt(socket_, IPPROTO_TCP, TCP_INFO, &info, &length) != 0) {
+    return false;
+  }
+  _info.rtt = info.tcpi_rtt;
+  _info.rtt_var = info.tcpi_rttvar;
+  _info.snd_cwnd = info.tcpi_snd_cwnd;
+  _info.retransmits = info.tcpi_retransmits;
+  _info.total_retrans = info.tcpi_total_retrans;
+  return true;
+#else
+  IgnoreUnused(_info);
+  return false;
+#endif
+}
+
 }  // namespace net
 }  // namespace hare
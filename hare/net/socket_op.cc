@@ -205,6 +205,29 @@ auto GetBytesReadableOnSocket(util_socket_t _fd) -> std::size_t {
 #endif
 }
 
+auto IncomingCpu(util_socket_t _fd) -> std::int32_t {
+#ifdef SO_INCOMING_CPU
+  auto cpu{-1};
+  auto len = static_cast<socklen_t>(sizeof(cpu));
+  if (::getsockopt(_fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len) < 0) {
+    return -1;
+  }
+  return cpu;
+#else
+  IgnoreUnused(_fd);
+  return -1;
+#endif
+}
+
+auto SocketError(util_socket_t _fd) -> std::int32_t {
+  std::int32_t error{0};
+  auto len = static_cast<socklen_t>(sizeof(error));
+  if (::getsockopt(_fd, SOL_SOCKET, SO_ERROR, (char*)&error, &len) < 0) {
+    return errno;
+  }
+  return error;
+}
+
 void ToIpPort(char* _buf, std::size_t size, const struct sockaddr* _addr) {
   if (_addr->sa_family == AF_INET6) {
     _buf[0] = '[';
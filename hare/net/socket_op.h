@@ -60,6 +60,16 @@ HARE_API auto Accept(util_socket_t _fd, struct sockaddr* _addr,
 HARE_API auto AddrLen(std::uint8_t _family) -> std::size_t;
 HARE_API auto GetBytesReadableOnSocket(util_socket_t _fd) -> std::size_t;
 
+/**
+ * @brief The CPU which processed the packets of socket, -1 if unknown.
+ **/
+HARE_API auto IncomingCpu(util_socket_t _fd) -> std::int32_t;
+
+/**
+ * @brief Takes the pending error of socket (SO_ERROR), 0 if none.
+ **/
+HARE_API auto SocketError(util_socket_t _fd) -> std::int32_t;
+
 HARE_API void ToIpPort(char* _buf, std::size_t _size,
                        const struct sockaddr* _addr);
 HARE_API void ToIp(char* _buf, std::size_t _size, const struct sockaddr* _addr);
@@ -71,37 +71,40 @@ void Acceptor::EventCallback(const Ptr<io::Event>& _event, std::uint8_t _events,
     return;
   }
 
-  HostAddress peer_addr{};
-  auto local_addr = HostAddress::LocalAddress(Socket());
-
-  auto accepted{false};
-  util_socket_t conn_fd{};
-
-  /// FIXME: loop until no more ?
-  while ((conn_fd = IMPL->socket.Accept(peer_addr)) >= 0) {
+  auto saved_errno{0};
+
+  // drains the backlog, so a storm of connections costs one wakeup.
+  for (;;) {
+    // the address is moved into the session.
+    HostAddress peer_addr{};
+    auto conn_fd = IMPL->socket.Accept(peer_addr);
+    if (conn_fd < 0) {
+      saved_errno = errno;
+      break;
+    }
     HARE_INTERNAL_TRACE("accepts of tcp[{}].", peer_addr.ToIpPort());
     if (IMPL->new_session) {
       IMPL->new_session(conn_fd, peer_addr, _receive_time, this);
     } else {
       socket_op::Close(conn_fd);
     }
-    accepted = true;
   }
 
-  if (!accepted) {
-    HARE_INTERNAL_ERROR("cannot accept new connect.");
+  // the backlog is drained, otherwise it stopped on an error.
+  if (saved_errno != EAGAIN && saved_errno != EWOULDBLOCK) {
+    HARE_INTERNAL_ERROR("cannot accept new connect, errno: {}.", saved_errno);
+  }
 #ifdef H_OS_LINUX
-    // Read the section named "The special problem of
-    // accept()ing when you can't" in libev's doc.
-    // By Marc Lehmann, author of libev.
-    if (errno == EMFILE) {
-      socket_op::Close(idle_fd_);
-      idle_fd_ = socket_op::Accept(IMPL->socket.fd(), nullptr, 0);
-      socket_op::Close(idle_fd_);
-      idle_fd_ = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
-    }
-#endif
+  // Read the section named "The special problem of
+  // accept()ing when you can't" in libev's doc.
+  // By Marc Lehmann, author of libev.
+  if (saved_errno == EMFILE) {
+    socket_op::Close(idle_fd_);
+    idle_fd_ = socket_op::Accept(IMPL->socket.fd(), nullptr, 0);
+    socket_op::Close(idle_fd_);
+    idle_fd_ = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
   }
+#endif
 }
 
 auto Acceptor::Listen() -> Error {
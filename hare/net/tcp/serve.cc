@@ -8,6 +8,9 @@
 #include "net/io_pool.h"
 #include "socket_op.h"
 
+#include <atomic>
+#include <vector>
+
 #if HARE__HAVE_NETINET_IN_H
 #include <netinet/in.h>
 #endif
@@ -17,6 +20,8 @@
 #include <Ws2tcpip.h>
 #endif
 
+#define PLACEMENT_WINDOW (1000 * 1000)
+
 namespace hare {
 namespace net {
 
@@ -24,7 +29,22 @@ HARE_IMPL_DEFAULT(TcpServe, std::string name{};
 
                   // the acceptor loop
                   io::Cycle * cycle{}; Ptr<IOPool<Ptr<TcpSession>>> io_pool{};
-                  std::uint64_t session_id{0}; bool started{false};
+                  std::atomic<std::uint64_t> session_id{0};
+                  bool started{false}; std::size_t budget_limit{0};
+                  std::int64_t idle_release{0};
+
+                  // with `ACCEPT_REUSE_PORT`, templates of the acceptors of
+                  // workers, `local_acceptors[i]` are owned by worker i.
+                  AcceptMode accept_mode{ACCEPT_MAIN};
+                  std::atomic<PlacementPolicy> placement{PLACEMENT_ROUND_ROBIN};
+                  std::atomic<std::uint64_t> locality_hits{0};
+
+                  // the rebalancer runs in the main cycle.
+                  std::int64_t rebalance_interval{0};
+                  double rebalance_ratio{2.0};
+                  std::atomic<std::uint64_t> migrations{0};
+                  std::vector<Ptr<Acceptor>> acceptors{};
+                  std::vector<std::vector<Ptr<Acceptor>>> local_acceptors{};
 
                   TcpServe::NewSessionCallback new_session{};)
 
@@ -47,7 +67,41 @@ void TcpServe::SetNewSession(NewSessionCallback _new_session) {
   IMPL->new_session = std::move(_new_session);
 }
 
+void TcpServe::SetAcceptMode(net::AcceptMode _mode) {
+  HARE_ASSERT(!IMPL->started && IMPL->acceptors.empty());
+  IMPL->accept_mode = _mode;
+}
+
+auto TcpServe::GetAcceptMode() const -> net::AcceptMode {
+  return IMPL->accept_mode;
+}
+
+void TcpServe::SetPlacementPolicy(PlacementPolicy _policy) {
+  IMPL->placement = _policy;
+}
+
+auto TcpServe::LocalityHits() const -> std::uint64_t {
+  return IMPL->locality_hits;
+}
+
 auto TcpServe::AddAcceptor(const Ptr<Acceptor>& _acceptor) -> bool {
+  if (IMPL->accept_mode == ACCEPT_REUSE_PORT) {
+    if (_acceptor->Port() == 0) {
+      HARE_INTERNAL_ERROR("acceptor[{}] needs a fixed port to be reused.",
+                          _acceptor->Socket());
+      return false;
+    }
+    if (IMPL->started) {
+      IMPL->cycle->RunInCycle([=] {
+        IMPL->acceptors.push_back(_acceptor);
+        StartLocalAcceptors();
+      });
+    } else {
+      IMPL->acceptors.push_back(_acceptor);
+    }
+    return true;
+  }
+
   util::CountDownLatch cdl(1);
   auto in_cycle = IMPL->cycle->InCycleThread();
   auto added{false};
@@ -60,6 +114,8 @@ auto TcpServe::AddAcceptor(const Ptr<Acceptor>& _acceptor) -> bool {
     auto ret = _acceptor->Listen();
     if (!ret) {
       HARE_INTERNAL_ERROR("acceptor[{}] cannot listen.", _acceptor->Socket());
+      // the cycle must not keep it.
+      _acceptor->Deactivate();
       cdl.CountDown();
       return;
     }
@@ -78,19 +134,54 @@ auto TcpServe::AddAcceptor(const Ptr<Acceptor>& _acceptor) -> bool {
   return added;
 }
 
+void TcpServe::SetIdleRelease(std::int64_t _idle) {
+  HARE_ASSERT(!IMPL->started);
+  IMPL->idle_release = _idle;
+}
+
+void TcpServe::SetBufferBudget(std::size_t _limit_per_worker) {
+  IMPL->budget_limit = _limit_per_worker;
+  if (IMPL->io_pool) {
+    for (const auto& item : IMPL->io_pool->items()) {
+      item->budget->SetLimit(_limit_per_worker);
+    }
+  }
+}
+
+auto TcpServe::BufferUsage() const -> std::size_t {
+  std::size_t usage{0};
+  if (IMPL->io_pool) {
+    for (const auto& item : IMPL->io_pool->items()) {
+      usage += item->budget->Usage();
+    }
+  }
+  return usage;
+}
+
 auto TcpServe::Exec(std::int32_t _thread_nbr) -> Error {
   HARE_ASSERT(IMPL->cycle != nullptr);
 
   IMPL->io_pool = std::make_shared<IOPool<Ptr<TcpSession>>>("SERVER_WORKER");
-  auto ret = IMPL->io_pool->Start(IMPL->cycle->type(), _thread_nbr);
+  auto ret = IMPL->io_pool->Start(IMPL->cycle->type(), _thread_nbr,
+                                  IMPL->placement == PLACEMENT_INCOMING_CPU);
   if (!ret) {
     return Error(ERROR_INIT_IO_POOL);
   }
+  SetBufferBudget(IMPL->budget_limit);
 
   IMPL->started = true;
+  StartLocalAcceptors();
+  IMPL->cycle->QueueInCycle([=] {
+    IMPL->cycle->RunEvery([=] { IMPL->io_pool->RotateWindow(); },
+                          PLACEMENT_WINDOW);
+    if (IMPL->rebalance_interval > 0) {
+      IMPL->cycle->RunEvery([=] { Rebalance(); }, IMPL->rebalance_interval);
+    }
+  });
   IMPL->cycle->Exec();
   IMPL->started = false;
 
+  StopLocalAcceptors();
   HARE_INTERNAL_TRACE("clean io pool...");
   IMPL->io_pool->Stop();
   IMPL->io_pool.reset();
@@ -100,61 +191,286 @@ auto TcpServe::Exec(std::int32_t _thread_nbr) -> Error {
 
 void TcpServe::Exit() { IMPL->cycle->Exit(); }
 
+auto TcpServe::Migrate(const Ptr<TcpSession>& _session, std::size_t _index)
+    -> bool {
+  if (!IMPL->started || !_session ||
+      _index >= IMPL->io_pool->items().size()) {
+    return false;
+  }
+  _session->OwnerCycle()->QueueInCycle(
+      std::bind(&TcpServe::MigrateInCycle, this, _session, _index));
+  return true;
+}
+
+void TcpServe::SetRebalance(std::int64_t _interval, double _ratio) {
+  HARE_ASSERT(!IMPL->started);
+  IMPL->rebalance_interval = _interval;
+  IMPL->rebalance_ratio = _ratio;
+}
+
+auto TcpServe::Migrations() const -> std::uint64_t {
+  return IMPL->migrations;
+}
+
 void TcpServe::NewSession(util_socket_t _fd, HostAddress& _address,
                           const Timestamp& _time, Acceptor* _acceptor) {
   HARE_ASSERT(IMPL->started);
   IMPL->cycle->AssertInCycleThread();
 
-  auto next_item = IMPL->io_pool->GetNextItem();
+  std::size_t index{0};
+  if (IMPL->placement == PLACEMENT_INCOMING_CPU) {
+    auto cpu = socket_op::IncomingCpu(_fd);
+    index = IMPL->io_pool->GetIndexByCpu(cpu);
+    if (cpu >= 0 && IMPL->io_pool->items()[index]->cpu == cpu) {
+      ++IMPL->locality_hits;
+    }
+  } else {
+    index = IMPL->io_pool->GetIndexByPolicy(IMPL->placement);
+  }
+  auto tcp_session = CreateSession(index, _fd, _address, _acceptor);
+  if (!tcp_session) {
+    return;
+  }
+
+  const auto& next_item = IMPL->io_pool->items()[index];
+  next_item->cycle->RunInCycle([=] {
+    EstablishSession(index, tcp_session, _time, _acceptor);
+  });
+}
+
+void TcpServe::NewLocalSession(std::size_t _index, util_socket_t _fd,
+                               HostAddress& _address, const Timestamp& _time,
+                               Acceptor* _acceptor) {
+  HARE_ASSERT(IMPL->started);
+  const auto& item = IMPL->io_pool->items()[_index];
+  item->cycle->AssertInCycleThread();
+  if (IMPL->placement == PLACEMENT_INCOMING_CPU && item->cpu >= 0 &&
+      socket_op::IncomingCpu(_fd) == item->cpu) {
+    ++IMPL->locality_hits;
+  }
+
+  auto tcp_session = CreateSession(_index, _fd, _address, _acceptor);
+  if (tcp_session) {
+    EstablishSession(_index, tcp_session, _time, _acceptor);
+  }
+}
+
+auto TcpServe::CreateSession(std::size_t _index, util_socket_t _fd,
+                             HostAddress& _address, Acceptor* _acceptor)
+    -> Ptr<TcpSession> {
+  const auto& next_item = IMPL->io_pool->items()[_index];
   Ptr<TcpSession> tcp_session{nullptr};
-  std::string name_cache{};
 
   HARE_ASSERT(_fd != -1);
-  auto local_addr = HostAddress::LocalAddress(_fd);
+  auto id = IMPL->session_id++;
 
-  name_cache = fmt::format("{}-{}#tcp{}", IMPL->name, local_addr.ToIpPort(),
-                           IMPL->session_id++);
+  HARE_INTERNAL_TRACE("new session[#tcp{}] in serve[{}] from {}.", id,
+                      IMPL->name, _address.ToIpPort());
 
-  HARE_INTERNAL_TRACE("new session[{}] in serve[{}] from {} in {}.", name_cache,
-                      IMPL->name, _address.ToIpPort(), _time.ToFmt());
-
-  tcp_session.reset(
-      new TcpSession(next_item->cycle.get(), std::move(local_addr), name_cache,
-                     _acceptor->Family(), _fd, std::move(_address)));
+  // the local address and the name are resolved when asked.
+  tcp_session.reset(new TcpSession(next_item->cycle.get(), IMPL->name, id,
+                                   _acceptor->Family(), _fd,
+                                   std::move(_address)));
 
   if (!tcp_session) {
-    HARE_INTERNAL_ERROR("fail to create session[{}].", name_cache);
+    HARE_INTERNAL_ERROR("fail to create session[#tcp{}].", id);
     socket_op::Close(_fd);
-    return;
+    return tcp_session;
   }
 
-  auto sfd = tcp_session->Fd();
+  BindSession(_index, tcp_session);
+  ++next_item->connections;
+  return tcp_session;
+}
 
-  tcp_session->SetDestroy([=]() {
-    next_item->cycle->RunInCycle([=]() mutable {
-      HARE_ASSERT(next_item->sessions.find(sfd) != next_item->sessions.end());
-      next_item->sessions.erase(sfd);
+void TcpServe::BindSession(std::size_t _index,
+                           const Ptr<TcpSession>& _session) {
+  const auto& item = IMPL->io_pool->items()[_index];
+  auto sfd = _session->Fd();
+  // blocks allocated before keep charging the previous budget until freed.
+  _session->SetBufferBudget(item->budget);
+  _session->SetTrafficCounter(
+      Ptr<std::atomic<std::uint64_t>>(item, &item->window_bytes));
+
+  auto owner = item;
+  _session->SetDestroy([=]() {
+    --owner->connections;
+    owner->cycle->RunInCycle([=]() mutable {
+      HARE_ASSERT(owner->sessions.find(sfd) != owner->sessions.end());
+      owner->sessions.erase(sfd);
     });
   });
+}
 
-  next_item->cycle->RunInCycle([=]() mutable {
-    HARE_ASSERT(next_item->sessions.find(sfd) == next_item->sessions.end());
-    if (!IMPL->new_session) {
-      HARE_INTERNAL_ERROR(
-          "you need register new_session_callback to serve[{}].", IMPL->name);
-      if (sfd != -1) {
-        socket_op::Close(sfd);
-      }
-      return;
+void TcpServe::EstablishSession(std::size_t _index,
+                                const Ptr<TcpSession>& _session,
+                                const Timestamp& _time, Acceptor* _acceptor) {
+  const auto& item = IMPL->io_pool->items()[_index];
+  auto sfd = _session->Fd();
+  HARE_ASSERT(item->sessions.find(sfd) == item->sessions.end());
+  if (!IMPL->new_session) {
+    HARE_INTERNAL_ERROR("you need register new_session_callback to serve[{}].",
+                        IMPL->name);
+    --item->connections;
+    if (sfd != -1) {
+      socket_op::Close(sfd);
     }
+    return;
+  }
+
+  item->sessions.insert(std::make_pair(sfd, _session));
+  _session->SetIdleRelease(IMPL->idle_release);
+  IMPL->new_session(
+      _session, _time,
+      std::static_pointer_cast<Acceptor>(_acceptor->shared_from_this()));
+  _session->ConnectEstablished();
+}
 
-    next_item->sessions.insert(std::make_pair(sfd, tcp_session));
-    IMPL->new_session(
-        tcp_session, _time,
-        std::static_pointer_cast<Acceptor>(_acceptor->shared_from_this()));
-    tcp_session->ConnectEstablished();
+void TcpServe::MigrateInCycle(const Ptr<TcpSession>& _session,
+                              std::size_t _index) {
+  auto* owner = _session->OwnerCycle();
+  if (!owner->InCycleThread()) {
+    // it has been migrated after being queued.
+    owner->QueueInCycle(
+        std::bind(&TcpServe::MigrateInCycle, this, _session, _index));
+    return;
+  }
+  if (!_session->Connected() || IMPL->io_pool->stopping()) {
+    // closed by the worker which owns it.
+    return;
+  }
+
+  const auto& items = IMPL->io_pool->items();
+  const auto& target = items[_index];
+  std::size_t from{0};
+  while (from < items.size() && items[from]->cycle.get() != owner) {
+    ++from;
+  }
+  if (from == items.size() || from == _index) {
+    return;
+  }
+  const auto& source = items[from];
+  auto sfd = _session->Fd();
+  auto iter = source->sessions.find(sfd);
+  if (iter == source->sessions.end() || iter->second != _session) {
+    return;
+  }
+
+  HARE_INTERNAL_TRACE("migrate session[{}] from worker[{}] to worker[{}].",
+                      _session->Name(), from, _index);
+  source->sessions.erase(iter);
+  --source->connections;
+  ++target->connections;
+  _session->Detach(target->cycle.get());
+  BindSession(_index, _session);
+  ++IMPL->migrations;
+
+  auto* item = target.get();
+  target->cycle->RunInCycle([=] {
+    item->sessions.insert(std::make_pair(sfd, _session));
+    _session->Attach();
   });
 }
 
+void TcpServe::Rebalance() {
+  IMPL->cycle->AssertInCycleThread();
+  const auto& items = IMPL->io_pool->items();
+  if (items.size() < 2) {
+    return;
+  }
+
+  std::size_t busiest{0};
+  std::size_t idlest{0};
+  for (std::size_t i = 1; i < items.size(); ++i) {
+    if (items[i]->Bytes() > items[busiest]->Bytes()) {
+      busiest = i;
+    }
+    if (items[i]->Bytes() < items[idlest]->Bytes()) {
+      idlest = i;
+    }
+  }
+  auto high = items[busiest]->Bytes();
+  auto low = items[idlest]->Bytes();
+  if (high == 0 || static_cast<double>(high) <=
+                       IMPL->rebalance_ratio * static_cast<double>(low)) {
+    return;
+  }
+
+  // moving more than half of the gap only swaps the roles of workers.
+  auto limit = (high - low) / 2;
+  items[busiest]->cycle->QueueInCycle(std::bind(
+      &TcpServe::RebalanceInCycle, this, busiest, idlest, limit));
+}
+
+void TcpServe::RebalanceInCycle(std::size_t _from, std::size_t _to,
+                                std::uint64_t _limit) {
+  const auto& source = IMPL->io_pool->items()[_from];
+  Ptr<TcpSession> hottest{};
+  std::uint64_t hottest_bytes{0};
+  for (const auto& session : source->sessions) {
+    auto bytes = session.second->TakeRecentBytes();
+    if (bytes > hottest_bytes && bytes <= _limit) {
+      hottest = session.second;
+      hottest_bytes = bytes;
+    }
+  }
+  if (hottest) {
+    MigrateInCycle(hottest, _to);
+  }
+}
+
+void TcpServe::StartLocalAcceptors() {
+  IMPL->cycle->AssertInCycleThread();
+  const auto& items = IMPL->io_pool->items();
+  IMPL->local_acceptors.resize(items.size());
+
+  for (std::size_t i = 0; i < items.size(); ++i) {
+    auto& locals = IMPL->local_acceptors[i];
+    for (auto j = locals.size(); j < IMPL->acceptors.size(); ++j) {
+      const auto& acceptor = IMPL->acceptors[j];
+      auto local =
+          std::make_shared<Acceptor>(acceptor->Family(), acceptor->Port());
+      locals.push_back(local);
+
+      const auto& item = items[i];
+      item->cycle->RunInCycle([=] {
+        item->cycle->EventUpdate(local);
+        local->SetNewSession(std::bind(&TcpServe::NewLocalSession, this, i,
+                                       std::placeholders::_1,
+                                       std::placeholders::_2,
+                                       std::placeholders::_3,
+                                       std::placeholders::_4));
+        auto ret = local->Listen();
+        if (!ret) {
+          HARE_INTERNAL_ERROR("acceptor[{}] of worker[{}] cannot listen.",
+                              local->Socket(), i);
+          return;
+        }
+        HARE_INTERNAL_TRACE(
+            "add acceptor[{}], port={}, type={}] to worker[{}].",
+            local->Socket(), local->Port(), TypeToStr(TYPE_TCP), i);
+      });
+    }
+  }
+}
+
+void TcpServe::StopLocalAcceptors() {
+  const auto& items = IMPL->io_pool->items();
+  for (std::size_t i = 0; i < IMPL->local_acceptors.size(); ++i) {
+    util::CountDownLatch cdl{1};
+    auto locals = std::move(IMPL->local_acceptors[i]);
+    items[i]->cycle->RunInCycle([&] {
+      for (const auto& local : locals) {
+        if (local->cycle() != nullptr) {
+          local->Deactivate();
+        }
+      }
+      cdl.CountDown();
+    });
+    cdl.Await();
+  }
+  IMPL->local_acceptors.clear();
+}
+
 }  // namespace net
 }  // namespace hare
\ No newline at end of file
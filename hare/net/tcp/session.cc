@@ -1,10 +1,30 @@
 #include <hare/base/io/operation.h>
+#include <hare/hare-config.h>
 #include <hare/net/tcp/session.h>
 
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <deque>
+#include <iterator>
+#include <mutex>
+#include <utility>
+#include <vector>
+
 #include "base/fwd-inl.h"
 #include "base/io/reactor.h"
+#include "socket_op.h"
+#include "timing_wheel.h"
+
+#if HARE__HAVE_SYS_UIO_H
+#include <sys/uio.h>
+#endif
 
 #define DEFAULT_HIGH_WATER (64UL * 1024 * 1024)
+#define BUDGET_RETRY_INTERVAL (10 * 1000)
+#define MAX_SEND_IOVEC 64
+#define OUTPUT_STAGE_SIZE (64UL * 1024)
+#define OUTPUT_QUANTUM (16UL * 1024)
 
 namespace hare {
 namespace net {
@@ -25,32 +45,197 @@ static auto StateToString(SessionState state) -> const char* {
       return "UNKNOWN STATE";
   }
 }
+static auto TimeoutToString(SessionTimeout reason) -> const char* {
+  switch (reason) {
+    case TIMEOUT_NONE:
+      return "TIMEOUT_NONE";
+    case TIMEOUT_IDLE:
+      return "TIMEOUT_IDLE";
+    case TIMEOUT_READ:
+      return "TIMEOUT_READ";
+    case TIMEOUT_WRITE:
+      return "TIMEOUT_WRITE";
+    default:
+      return "UNKNOWN TIMEOUT";
+  }
+}
+static auto EmptyCallbacks() -> const Ptr<const TcpSession::Callbacks>& {
+  static const Ptr<const TcpSession::Callbacks> empty{
+      std::make_shared<TcpSession::Callbacks>()};
+  return empty;
+}
+
+// the scratch buffer of shared reads, one per cycle thread. It is held
+// by the cycle rather than any session, so it is charged to a budget of
+// its own instead of the global one or the budget of a worker.
+struct SharedRead {
+  Buffer buffer{};
+  bool busy{false};
+
+  SharedRead() { buffer.SetBudget(std::make_shared<BufferBudget>(0, nullptr)); }
+};
+static auto AcquireSharedRead() -> SharedRead* {
+  static thread_local SharedRead shared{};
+  if (shared.busy) {
+    return nullptr;
+  }
+  shared.busy = true;
+  return &shared;
+}
+static void ReleaseSharedRead(SharedRead* _shared, Buffer& _leftover) {
+  auto cursor = _shared->buffer.Cursor();
+  do {
+    auto span = cursor.Span();
+    if (span.size > 0) {
+      _leftover.Add(span.data, span.size);
+    }
+  } while (cursor.NextSegment());
+  _shared->buffer.ClearAll();
+  _shared->busy = false;
+}
+
+// the sessions paused by the budget, retried by one timer per cycle.
+struct BudgetRetry {
+  io::Cycle* cycle{nullptr};
+  std::vector<WPtr<TcpSession>> sessions{};
+  bool armed{false};
+};
+static auto LocalBudgetRetry(io::Cycle* _cycle) -> BudgetRetry& {
+  static thread_local BudgetRetry retry{};
+  if (retry.cycle != _cycle) {
+    // the cycle of thread was replaced, its timer is gone.
+    retry.sessions.clear();
+    retry.cycle = _cycle;
+    retry.armed = false;
+  }
+  return retry;
+}
+
+struct OutputMessage {
+  Buffer data{};
+  TcpSession::SendComplete done{};
+};
+struct OutputQueue {
+  std::deque<OutputMessage> messages{};
+  std::uint32_t weight{1};
+  std::size_t deficit{0};
+};
+
+// the state of features most sessions never use, allocated on first use,
+// so an idle session does not pay for it.
+struct SessionExtension {
+  // the send tokens by their end offset in the output.
+  std::vector<std::pair<std::uint64_t, TcpSession::SendComplete>>
+      completions{};
+  bool completion_queued{false};
+
+  // empty unless `SetOutputQueues()`, the messages are moved into
+  // `out_buffer` at their boundaries.
+  std::vector<OutputQueue> queues{};
+  std::size_t queued_bytes{0};
+  std::size_t queued_messages{0};
+  std::size_t queue_turn{0};
+  OutputPolicy output_policy{OUTPUT_STRICT};
+  std::uint32_t notsent_lowat{0};
+
+  // the kernel time of the last read, see `ReceiveTime()`.
+  Timestamp receive_time{};
+
+  // see `Stats()`, a sampling task stops when its generation is outdated.
+  std::int64_t info_interval{0};
+  std::uint64_t info_generation{0};
+  TcpInfo tcp_info{};
+  Timestamp info_time{};
+  std::int64_t kernel_queued{-1};
+  std::int64_t kernel_unsent{-1};
+};
 }  // namespace detail
 
-HARE_IMPL_DEFAULT(TcpSession, std::string name{}; io::Cycle * cycle{nullptr};
+HARE_IMPL_DEFAULT(TcpSession, std::string name{};
+                  std::atomic<io::Cycle*> cycle{nullptr};
                   Ptr<io::Event> event{nullptr}; Socket socket;
 
-                  const HostAddress local_addr{}; const HostAddress peer_addr{};
+                  // the local address and the name may be resolved lazily.
+                  HostAddress local_addr{}; const HostAddress peer_addr{};
+                  std::uint64_t id{0}; std::once_flag local_once{};
+                  std::once_flag name_once{};
 
                   bool reading{false}; SessionState state{STATE_CONNECTING};
+                  bool budget_paused{false}; bool budget_queued{false};
+
+                  // the output is held until uncorked or the end of turn.
+                  bool corked{false}; bool auto_cork{false};
+                  bool flush_queued{false};
 
                   Buffer out_buffer{}; Buffer in_buffer{};
+                  // see `SetZeroCopy()`, also applied to direct writes.
+                  std::size_t zerocopy_threshold{0};
+
+                  // the offset after the accepted data in the output.
+                  std::uint64_t stream_end{0};
+                  bool shared_read{false}; bool recv_timestamp{false};
+                  UPtr<detail::SessionExtension> extension{};
 
                   std::size_t high_water_mark{DEFAULT_HIGH_WATER};
-                  TcpSession::WriteCallback write{};
-                  TcpSession::HighWaterCallback high_water{};
-                  TcpSession::ReadRallback read{};
-                  TcpSession::ConnectCallback connect{};
+                  std::size_t low_water_mark{0};
+
+                  // `throttling` is set on the sink, `water_paused` on the
+                  // source whose reading is paused.
+                  bool flow_control{false}; bool throttling{false};
+                  bool water_paused{false}; bool paired{false};
+                  WPtr<TcpSession> flow_source{};
+
+                  // times in us, the deadlines are checked by the wheel.
+                  std::int64_t idle_timeout{0}; std::int64_t read_timeout{0};
+                  std::int64_t write_timeout{0}; std::int64_t last_read{0};
+                  std::int64_t last_write{0}; std::int64_t wheel_deadline{0};
+                  SessionTimeout timeout_reason{TIMEOUT_NONE};
+
+                  // the buffers are freed after idle for `idle_release`,
+                  // checked again from `release_since` if they were busy.
+                  std::int64_t idle_release{0};
+                  std::int64_t release_since{0}; bool idle_released{false};
+
+                  // bytes moved by the sessions of a worker, for placement.
+                  Ptr<std::atomic<std::uint64_t>> traffic{};
+                  std::uint64_t recent_bytes{0};
+
+                  // see `Stats()`.
+                  std::uint64_t bytes_in{0}; std::uint64_t bytes_out{0};
+                  std::uint64_t reads{0}; std::uint64_t writes{0};
+                  std::size_t output_peak{0};
+
+                  // shared with other sessions unless `own_callbacks`.
+                  Ptr<const TcpSession::Callbacks> callbacks{
+                      detail::EmptyCallbacks()};
+                  bool own_callbacks{false};
                   TcpSession::SessionDestroy destroy{};
 
                   util::Any any_ctx{};
 
-                  TcpSessionImpl(HostAddress _local_addr, std::uint8_t _family,
-                                 util_socket_t _fd, HostAddress _peer_addr)
+                  TcpSessionImpl(std::uint8_t _family, util_socket_t _fd,
+                                 HostAddress _peer_addr)
                   : socket(_family, TYPE_TCP, _fd),
-                    local_addr(std::move(_local_addr)),
                     peer_addr(std::move(_peer_addr)){})
 
+namespace detail {
+static auto Extend(TcpSessionImpl* _impl) -> SessionExtension& {
+  if (!_impl->extension) {
+    _impl->extension.reset(new SessionExtension());
+  }
+  return *_impl->extension;
+}
+static auto HasQueues(const TcpSessionImpl* _impl) -> bool {
+  return _impl->extension && !_impl->extension->queues.empty();
+}
+static auto QueuedBytes(const TcpSessionImpl* _impl) -> std::size_t {
+  return _impl->extension ? _impl->extension->queued_bytes : 0;
+}
+static auto QueuedMessages(const TcpSessionImpl* _impl) -> std::size_t {
+  return _impl->extension ? _impl->extension->queued_messages : 0;
+}
+}  // namespace detail
+
 TcpSession::~TcpSession() {
   HARE_ASSERT(IMPL->state == STATE_DISCONNECTED);
   HARE_INTERNAL_TRACE("session[{}] at {} fd={} free.", IMPL->name, (void*)this,
@@ -58,9 +243,19 @@ TcpSession::~TcpSession() {
   delete impl_;
 }
 
-auto TcpSession::Name() const -> std::string { return IMPL->name; }
+auto TcpSession::Name() const -> std::string {
+  std::call_once(IMPL->name_once, [this] {
+    // `name` holds the prefix until now.
+    IMPL->name = fmt::format("{}-{}#tcp{}", IMPL->name,
+                             LocalAddress().ToIpPort(), IMPL->id);
+  });
+  return IMPL->name;
+}
 auto TcpSession::OwnerCycle() const -> io::Cycle* { return IMPL->cycle; }
 auto TcpSession::LocalAddress() const -> const HostAddress& {
+  std::call_once(IMPL->local_once, [this] {
+    IMPL->local_addr = HostAddress::LocalAddress(Fd());
+  });
   return IMPL->local_addr;
 }
 auto TcpSession::PeerAddress() const -> const HostAddress& {
@@ -72,17 +267,67 @@ auto TcpSession::Fd() const -> util_socket_t { return IMPL->socket.fd(); }
 void TcpSession::SetHighWaterMark(std::size_t _hwm) {
   IMPL->high_water_mark = _hwm;
 }
+void TcpSession::SetLowWaterMark(std::size_t _lwm) {
+  IMPL->low_water_mark = _lwm;
+}
+void TcpSession::SetFlowControl(bool _on) {
+  IMPL->flow_control = _on;
+  if (!_on && IMPL->throttling) {
+    ThrottleSource(false);
+  }
+}
+void TcpSession::SetFlowSource(const Ptr<TcpSession>& _source) {
+  if (IMPL->throttling) {
+    ThrottleSource(false);
+  }
+  IMPL->flow_source = _source;
+  IMPL->paired = static_cast<bool>(_source);
+}
 void TcpSession::SetReadCallback(ReadRallback _read) {
-  IMPL->read = std::move(_read);
+  MutableCallbacks().read = std::move(_read);
 }
 void TcpSession::SetWriteCallback(WriteCallback _write) {
-  IMPL->write = std::move(_write);
+  MutableCallbacks().write = std::move(_write);
 }
 void TcpSession::SetHighWaterCallback(HighWaterCallback _high_water) {
-  IMPL->high_water = std::move(_high_water);
+  MutableCallbacks().high_water = std::move(_high_water);
 }
 void TcpSession::SetConnectCallback(ConnectCallback _connect) {
-  IMPL->connect = std::move(_connect);
+  MutableCallbacks().connect = std::move(_connect);
+}
+void TcpSession::SetCallbacks(const Ptr<const Callbacks>& _callbacks) {
+  IMPL->callbacks = _callbacks ? _callbacks : detail::EmptyCallbacks();
+  IMPL->own_callbacks = false;
+}
+
+void TcpSession::SetBufferBudget(const Ptr<BufferBudget>& _budget) {
+  IMPL->in_buffer.SetBudget(_budget);
+  IMPL->out_buffer.SetBudget(_budget);
+}
+void TcpSession::SetBufferTrim(std::size_t _max_retained,
+                               std::uint32_t _idle_rounds) {
+  IMPL->in_buffer.SetTrimPolicy(_max_retained, _idle_rounds);
+  IMPL->out_buffer.SetTrimPolicy(_max_retained, _idle_rounds);
+}
+void TcpSession::SetSharedRead(bool _on) { IMPL->shared_read = _on; }
+void TcpSession::SetBudgetCallback(BudgetCallback _budget) {
+  MutableCallbacks().budget = std::move(_budget);
+}
+
+void TcpSession::SetIdleTimeout(std::int64_t _timeout) {
+  IMPL->idle_timeout = _timeout;
+  ArmTimeout();
+}
+void TcpSession::SetReadTimeout(std::int64_t _timeout) {
+  IMPL->read_timeout = _timeout;
+  ArmTimeout();
+}
+void TcpSession::SetWriteTimeout(std::int64_t _timeout) {
+  IMPL->write_timeout = _timeout;
+  ArmTimeout();
+}
+auto TcpSession::TimeoutReason() const -> SessionTimeout {
+  return IMPL->timeout_reason;
 }
 
 void TcpSession::SetContext(const util::Any& context) {
@@ -111,72 +356,215 @@ auto TcpSession::ForceClose() -> Error {
   return Error(ERROR_SESSION_ALREADY_DISCONNECT);
 }
 
+auto TcpSession::SetZeroCopy(std::size_t _threshold) -> Error {
+  if (_threshold != 0) {
+    auto ret = IMPL->socket.SetZeroCopy(true);
+    if (!ret) {
+      return ret;
+    }
+  }
+  IMPL->out_buffer.SetZeroCopy(_threshold);
+  IMPL->zerocopy_threshold = _threshold;
+  return Error(ERROR_SUCCESS);
+}
+
+void TcpSession::SetOutputSpill(std::size_t _threshold) {
+  IMPL->out_buffer.SetSpill(_threshold);
+}
+
+void TcpSession::SetOutputQueues(std::size_t _count, OutputPolicy _policy) {
+  OwnerCycle()->AssertInCycleThread();
+  HARE_ASSERT(detail::QueuedMessages(IMPL) == 0);
+  auto& extension = detail::Extend(IMPL);
+  // default-constructed in place, the messages cannot be copied.
+  decltype(extension.queues)(_count).swap(extension.queues);
+  extension.queue_turn = 0;
+  extension.output_policy = _policy;
+}
+void TcpSession::SetQueueWeight(std::size_t _queue, std::uint32_t _weight) {
+  if (detail::HasQueues(IMPL) && _queue < IMPL->extension->queues.size()) {
+    IMPL->extension->queues[_queue].weight = Max(_weight, 1U);
+  }
+}
+
+auto TcpSession::SetNotSentLowat(std::uint32_t _bytes) -> Error {
+  OwnerCycle()->AssertInCycleThread();
+  auto ret = IMPL->socket.SetNotSentLowat(_bytes);
+  if (ret && (_bytes != 0 || IMPL->extension)) {
+    detail::Extend(IMPL).notsent_lowat = _bytes;
+  }
+  return ret;
+}
+
+auto TcpSession::SetRecvTimestamp(bool _on) -> Error {
+  OwnerCycle()->AssertInCycleThread();
+  auto ret = IMPL->socket.SetRecvTimestamp(_on);
+  if (ret) {
+    IMPL->recv_timestamp = _on;
+    if (_on || IMPL->extension) {
+      detail::Extend(IMPL).receive_time = Timestamp();
+    }
+  }
+  return ret;
+}
+auto TcpSession::ReceiveTime() const -> Timestamp {
+  return IMPL->extension ? IMPL->extension->receive_time : Timestamp();
+}
+
+void TcpSession::SetStatsInterval(std::int64_t _interval) {
+  OwnerCycle()->AssertInCycleThread();
+  if (_interval <= 0 && !IMPL->extension) {
+    return;
+  }
+  detail::Extend(IMPL).info_interval = _interval;
+  if (_interval > 0 && Connected()) {
+    SampleInfo();
+  }
+  ArmSampling();
+}
+
+auto TcpSession::Stats() const -> SessionStats {
+  SessionStats stats{};
+  stats.pending_output = PendingOutput();
+  stats.bytes_in = IMPL->bytes_in;
+  stats.bytes_out = IMPL->bytes_out;
+  stats.reads = IMPL->reads;
+  stats.writes = IMPL->writes;
+  stats.output_peak = Max(IMPL->output_peak, stats.pending_output);
+  if (IMPL->extension) {
+    stats.kernel_queued = IMPL->extension->kernel_queued;
+    stats.kernel_unsent = IMPL->extension->kernel_unsent;
+    stats.tcp_info = IMPL->extension->tcp_info;
+    stats.info_time = IMPL->extension->info_time;
+  }
+  return stats;
+}
+
+void TcpSession::SetAutoCork(bool _on) {
+  OwnerCycle()->AssertInCycleThread();
+  IMPL->auto_cork = _on;
+  if (!_on) {
+    Flush();
+  }
+}
+
+void TcpSession::Cork() {
+  OwnerCycle()->AssertInCycleThread();
+  IMPL->corked = true;
+}
+
+void TcpSession::Uncork() {
+  OwnerCycle()->AssertInCycleThread();
+  IMPL->corked = false;
+  Flush();
+}
+
 void TcpSession::StartRead() {
   if (!IMPL->reading || !IMPL->event->Reading()) {
     IMPL->event->EnableRead();
     IMPL->reading = true;
+    if (IMPL->read_timeout > 0) {
+      // the paused time is not counted.
+      IMPL->last_read = Timestamp::Now().microseconds_since_epoch();
+      ArmTimeout();
+    }
   }
 }
 
 void TcpSession::StopRead() {
-  if (IMPL->reading || IMPL->event->Reading()) {
-    IMPL->event->DisableRead();
-    IMPL->reading = false;
-  }
+  IMPL->budget_paused = false;
+  IMPL->water_paused = false;
+  PauseRead();
 }
 
-auto TcpSession::Append(Buffer& _buffer) -> bool {
+auto TcpSession::Append(Buffer& _buffer, SendComplete _done) -> bool {
   if (State() == STATE_CONNECTED) {
+    if (OwnerCycle()->InCycleThread() && detail::HasQueues(IMPL)) {
+      QueueMessage(IMPL->extension->queues.size() - 1, _buffer,
+                   std::move(_done));
+      return true;
+    } else if (OwnerCycle()->InCycleThread()) {
+      AppendInCycle(_buffer);
+      if (_done) {
+        AddCompletion(std::move(_done));
+      }
+      return true;
+    }
     auto tmp = std::make_shared<Buffer>();
     tmp->Append(_buffer);
     OwnerCycle()->QueueInCycle(std::bind(
-        [](const WPtr<TcpSession>& session, hare::Ptr<Buffer>& buffer) {
+        [](const WPtr<TcpSession>& session, hare::Ptr<Buffer>& buffer,
+           SendComplete& done) {
           auto tcp = session.lock();
-          if (tcp) {
-            auto out_buffer_size = d_ptr(tcp->impl_)->out_buffer.Size();
-            d_ptr(tcp->impl_)->out_buffer.Append(*buffer);
-            if (out_buffer_size == 0) {
-              tcp->Event()->EnableWrite();
-              tcp->HandleWrite();
-            } else if (out_buffer_size > d_ptr(tcp->impl_)->high_water_mark &&
-                       d_ptr(tcp->impl_)->high_water_mark) {
-              d_ptr(tcp->impl_)->high_water(tcp);
-            } else if (out_buffer_size > d_ptr(tcp->impl_)->high_water_mark) {
-              HARE_INTERNAL_ERROR(
-                  "high_water_mark_callback has not been set for "
-                  "tcp-session[{}].",
-                  tcp->Name());
-            }
+          if (tcp && tcp->Connected()) {
+            // dispatched again if the session was migrated meanwhile.
+            tcp->Append(*buffer, std::move(done));
+          } else if (tcp && done) {
+            done(tcp, false);
           }
         },
-        shared_from_this(), std::move(tmp)));
+        shared_from_this(), std::move(tmp), std::move(_done)));
     return true;
   }
   return false;
 }
 
-auto TcpSession::Send(const void* _bytes, std::size_t _length) -> bool {
+auto TcpSession::Send(const void* _bytes, std::size_t _length,
+                      SendComplete _done) -> bool {
   if (State() == STATE_CONNECTED) {
+    if (OwnerCycle()->InCycleThread() && detail::HasQueues(IMPL)) {
+      return SendTo(IMPL->extension->queues.size() - 1, _bytes, _length,
+                    std::move(_done));
+    } else if (OwnerCycle()->InCycleThread()) {
+      SendInCycle(_bytes, _length);
+      if (_done) {
+        AddCompletion(std::move(_done));
+      }
+      return true;
+    }
     auto tmp = std::make_shared<Buffer>();
     tmp->Add(_bytes, _length);
+    OwnerCycle()->QueueInCycle(std::bind(
+        [](const WPtr<TcpSession>& session, hare::Ptr<Buffer>& buffer,
+           SendComplete& done) {
+          auto tcp = session.lock();
+          if (tcp && tcp->Connected()) {
+            // dispatched again if the session was migrated meanwhile.
+            tcp->Append(*buffer, std::move(done));
+          } else if (tcp && done) {
+            done(tcp, false);
+          }
+        },
+        shared_from_this(), std::move(tmp), std::move(_done)));
+    return true;
+  }
+  return false;
+}
+
+auto TcpSession::SendV(const BufferSpan* _spans, std::size_t _count) -> bool {
+  if (State() == STATE_CONNECTED) {
+    if (OwnerCycle()->InCycleThread() && detail::HasQueues(IMPL)) {
+      Buffer message{};
+      message.SetBudget(IMPL->out_buffer.Budget());
+      for (std::size_t i = 0; i < _count; ++i) {
+        message.Add(_spans[i].data, _spans[i].size);
+      }
+      QueueMessage(IMPL->extension->queues.size() - 1, message, {});
+      return true;
+    } else if (OwnerCycle()->InCycleThread()) {
+      SendVInCycle(_spans, _count);
+      return true;
+    }
+    auto tmp = std::make_shared<Buffer>();
+    for (std::size_t i = 0; i < _count; ++i) {
+      tmp->Add(_spans[i].data, _spans[i].size);
+    }
     OwnerCycle()->QueueInCycle(std::bind(
         [](const WPtr<TcpSession>& session, hare::Ptr<Buffer>& buffer) {
           auto tcp = session.lock();
-          if (tcp) {
-            auto out_buffer_size = d_ptr(tcp->impl_)->out_buffer.Size();
-            d_ptr(tcp->impl_)->out_buffer.Append(*buffer);
-            if (out_buffer_size == 0) {
-              tcp->Event()->EnableWrite();
-              tcp->HandleWrite();
-            } else if (out_buffer_size > d_ptr(tcp->impl_)->high_water_mark &&
-                       d_ptr(tcp->impl_)->high_water_mark) {
-              d_ptr(tcp->impl_)->high_water(tcp);
-            } else if (out_buffer_size > d_ptr(tcp->impl_)->high_water_mark) {
-              HARE_INTERNAL_ERROR(
-                  "high_water_mark_callback has not been set for "
-                  "tcp-session[{}].",
-                  tcp->Name());
-            }
+          if (tcp && tcp->Connected()) {
+            // dispatched again if the session was migrated meanwhile.
+            tcp->Append(*buffer);
           }
         },
         shared_from_this(), std::move(tmp)));
@@ -185,18 +573,76 @@ auto TcpSession::Send(const void* _bytes, std::size_t _length) -> bool {
   return false;
 }
 
+auto TcpSession::SendV(Buffer* const* _buffers, std::size_t _count) -> bool {
+  if (State() == STATE_CONNECTED) {
+    Buffer chained{};
+    for (std::size_t i = 0; i < _count; ++i) {
+      chained.Append(*_buffers[i]);
+    }
+    return Append(chained);
+  }
+  return false;
+}
+
+auto TcpSession::SendTo(std::size_t _queue, const void* _bytes,
+                        std::size_t _length, SendComplete _done) -> bool {
+  if (State() == STATE_CONNECTED) {
+    Buffer message{};
+    message.SetBudget(IMPL->out_buffer.Budget());
+    message.Add(_bytes, _length);
+    return AppendTo(_queue, message, std::move(_done));
+  }
+  return false;
+}
+
+auto TcpSession::AppendTo(std::size_t _queue, Buffer& _buffer,
+                          SendComplete _done) -> bool {
+  if (State() == STATE_CONNECTED) {
+    if (OwnerCycle()->InCycleThread()) {
+      QueueMessage(_queue, _buffer, std::move(_done));
+      return true;
+    }
+    auto tmp = std::make_shared<Buffer>();
+    tmp->Append(_buffer);
+    OwnerCycle()->QueueInCycle(std::bind(
+        [](const WPtr<TcpSession>& session, std::size_t queue,
+           hare::Ptr<Buffer>& buffer, SendComplete& done) {
+          auto tcp = session.lock();
+          if (tcp && tcp->Connected()) {
+            // dispatched again if the session was migrated meanwhile.
+            tcp->AppendTo(queue, *buffer, std::move(done));
+          } else if (tcp && done) {
+            done(tcp, false);
+          }
+        },
+        shared_from_this(), _queue, std::move(tmp), std::move(_done)));
+    return true;
+  }
+  return false;
+}
+
 TcpSession::TcpSession(io::Cycle* _cycle, HostAddress _local_addr,
                        std::string _name, std::uint8_t _family,
                        util_socket_t _fd, HostAddress _peer_addr)
-    : impl_(new TcpSessionImpl(std::move(_local_addr), _family, _fd,
-                               std::move(_peer_addr))) {
+    : TcpSession(_cycle, std::move(_name), 0, _family, _fd,
+                 std::move(_peer_addr)) {
+  std::call_once(IMPL->local_once,
+                 [&] { IMPL->local_addr = std::move(_local_addr); });
+  std::call_once(IMPL->name_once, [] {});
+}
+
+TcpSession::TcpSession(io::Cycle* _cycle, std::string _prefix,
+                       std::uint64_t _id, std::uint8_t _family,
+                       util_socket_t _fd, HostAddress _peer_addr)
+    : impl_(new TcpSessionImpl(_family, _fd, std::move(_peer_addr))) {
   IMPL->cycle = CHECK_NULL(_cycle);
   IMPL->event.reset(new io::Event(
       _fd,
       std::bind(&TcpSession::HandleCallback, this, std::placeholders::_1,
                 std::placeholders::_2, std::placeholders::_3),
       SESSION_READ | SESSION_WRITE | io::EVENT_PERSIST, 0));
-  IMPL->name = std::move(_name);
+  IMPL->name = std::move(_prefix);
+  IMPL->id = _id;
 }
 
 void TcpSession::SetState(SessionState _state) { IMPL->state = _state; }
@@ -212,8 +658,19 @@ void TcpSession::HandleCallback(const Ptr<io::Event>& _event,
   OwnerCycle()->AssertInCycleThread();
   HARE_ASSERT(_event == IMPL->event);
   HARE_INTERNAL_TRACE("session[{}] revents: {}.", IMPL->event->fd(), _events);
-  if (CHECK_EVENT(_events, SESSION_READ)) {
+  if (IMPL->out_buffer.ZeroCopyPending() > 0) {
+    // completions of zero-copy sends are notified as an error.
+    IMPL->out_buffer.ReapZeroCopy(Fd());
+  }
+  if (CHECK_EVENT(_events, SESSION_READ) && IMPL->reading) {
     HandleRead(_receive_time);
+  } else if (CHECK_EVENT(_events, SESSION_READ) &&
+             socket_op::SocketError(Fd()) != 0) {
+    /**
+     * @brief EPOLLERR is reported as readable even if reading is paused,
+     *   the pending error is taken here, so it is not reported again.
+     **/
+    HandleError();
   }
   if (CHECK_EVENT(_events, SESSION_WRITE)) {
     HandleWrite();
@@ -224,11 +681,44 @@ void TcpSession::HandleCallback(const Ptr<io::Event>& _event,
 }
 
 void TcpSession::HandleRead(const Timestamp& _time) {
-  auto read_n = IMPL->in_buffer.Read(Fd(), -1);
+  auto* shared = IMPL->shared_read && IMPL->in_buffer.Size() == 0
+                     ? detail::AcquireSharedRead()
+                     : nullptr;
+  auto& buffer = shared != nullptr ? shared->buffer : IMPL->in_buffer;
+  // the extension is allocated by `SetRecvTimestamp()`.
+  auto read_n = IMPL->recv_timestamp
+                    ? buffer.Read(Fd(), IMPL->extension->receive_time)
+                    : buffer.Read(Fd());
+  auto saved_errno = errno;
+  if (read_n > 0) {
+    // counted even if nobody takes the data.
+    Account(static_cast<std::size_t>(read_n), true);
+  }
+  auto delivered = read_n > 0 && IMPL->callbacks->read;
+  if (delivered) {
+    IMPL->last_read = _time.microseconds_since_epoch();
+    RearmRelease();
+    // the table may be replaced by the callback.
+    auto callbacks = IMPL->callbacks;
+    callbacks->read(shared_from_this(), buffer, _time);
+  }
+  if (shared != nullptr) {
+    detail::ReleaseSharedRead(shared, IMPL->in_buffer);
+  } else if (IMPL->shared_read && IMPL->in_buffer.Size() == 0) {
+    // the partial frame is done, holds no receive memory again.
+    IMPL->in_buffer.ShrinkToFit();
+  }
+
   if (read_n == 0) {
     HandleClose();
-  } else if (read_n > 0 && IMPL->read) {
-    IMPL->read(shared_from_this(), IMPL->in_buffer, _time);
+  } else if (delivered) {
+    if (IMPL->in_buffer.Budget()->Exceeded()) {
+      HandleBudget();
+    }
+  } else if (read_n < 0 && (saved_errno == EAGAIN ||
+                            saved_errno == EWOULDBLOCK ||
+                            saved_errno == EINTR)) {
+    HARE_INTERNAL_TRACE("tcp-session[{}] has nothing to read.", Name());
   } else {
     if (read_n > 0) {
       HARE_INTERNAL_ERROR("read_callback has not been set for tcp-session[{}].",
@@ -239,33 +729,21 @@ void TcpSession::HandleRead(const Timestamp& _time) {
 }
 
 void TcpSession::HandleWrite() {
-  if (Event()->Writing()) {
-    auto write_n = IMPL->out_buffer.Write(Fd(), -1);
-    if (write_n >= 0) {
-      if (IMPL->out_buffer.Size() == 0) {
-        Event()->DisableWrite();
-        OwnerCycle()->QueueInCycle(std::bind(
-            [=](const WPtr<TcpSession>& session) {
-              auto tcp = session.lock();
-              if (tcp) {
-                if (IMPL->write) {
-                  IMPL->write(tcp);
-                } else {
-                  HARE_INTERNAL_ERROR(
-                      "write_callback has not been set for tcp-session[{}].",
-                      Name());
-                }
-              }
-            },
-            shared_from_this()));
-      }
-      if (State() == STATE_DISCONNECTING) {
-        HandleClose();
-      }
-    } else {
-      HARE_INTERNAL_ERROR(
-          "an error occurred while writing the socket, detail: {}.",
-          io::SocketErrorInfo(Fd()));
+  if (Event()->Writing() && IMPL->corked) {
+    // resumed by `Uncork()`.
+    Event()->DisableWrite();
+  } else if (Event()->Writing()) {
+    // errors are reported by `WriteOutput()`.
+    Account(WriteOutput(), false);
+    TouchWrite();
+    CheckCompletions();
+    CheckLowWater();
+    if (PendingOutput() == 0) {
+      Event()->DisableWrite();
+      WriteComplete();
+    }
+    if (State() == STATE_DISCONNECTING) {
+      HandleClose();
     }
   } else {
     HARE_INTERNAL_TRACE("tcp-session[fd={}, name={}] is down, no more writing.",
@@ -280,14 +758,45 @@ void TcpSession::HandleClose() {
               IMPL->state == STATE_DISCONNECTING);
   // we don't close fd, leave it to dtor, so we can find leaks easily.
   SetState(STATE_DISCONNECTED);
+  if (IMPL->throttling) {
+    ThrottleSource(false);
+  }
   IMPL->event->DisableRead();
   IMPL->event->DisableWrite();
-  if (IMPL->connect) {
-    IMPL->connect(shared_from_this(), SESSION_CLOSED);
+  auto* extension = IMPL->extension.get();
+  if (extension != nullptr && (!extension->completions.empty() ||
+                               extension->queued_messages > 0)) {
+    decltype(extension->completions) pending{};
+    pending.swap(extension->completions);
+    auto written = IMPL->stream_end - IMPL->out_buffer.Size();
+    auto self = shared_from_this();
+    for (auto& completion : pending) {
+      completion.second(self, completion.first <= written);
+    }
+    // the queued messages were never taken.
+    decltype(extension->queues) queues{};
+    queues.swap(extension->queues);
+    extension->queued_bytes = 0;
+    extension->queued_messages = 0;
+    for (auto& queue : queues) {
+      for (auto& message : queue.messages) {
+        if (message.done) {
+          message.done(self, false);
+        }
+      }
+    }
+  }
+  auto callbacks = IMPL->callbacks;
+  if (callbacks->connect) {
+    callbacks->connect(shared_from_this(),
+                       IMPL->timeout_reason != TIMEOUT_NONE
+                           ? static_cast<std::uint8_t>(SESSION_CLOSED |
+                                                       SESSION_TIMEOUT)
+                           : static_cast<std::uint8_t>(SESSION_CLOSED));
   } else {
     HARE_INTERNAL_ERROR(
         "connect_callback has not been set for session[{}], session is closed.",
-        IMPL->name);
+        Name());
   }
   IMPL->event->Deactivate();
   HARE_ASSERT(IMPL->destroy);
@@ -295,27 +804,739 @@ void TcpSession::HandleClose() {
 }
 
 void TcpSession::HandleError() {
-  if (IMPL->connect) {
-    IMPL->connect(shared_from_this(), SESSION_ERROR);
+  auto callbacks = IMPL->callbacks;
+  if (callbacks->connect) {
+    callbacks->connect(shared_from_this(), SESSION_ERROR);
   } else {
     HARE_INTERNAL_ERROR("occurred error to the session[{}], detail: {}.",
-                        IMPL->name, io::SocketErrorInfo(Fd()));
+                        Name(), io::SocketErrorInfo(Fd()));
   }
 }
 
+void TcpSession::HandleBudget() {
+  auto callbacks = IMPL->callbacks;
+  if (callbacks->budget) {
+    callbacks->budget(shared_from_this());
+    return;
+  }
+
+  if (!IMPL->budget_paused) {
+    HARE_INTERNAL_TRACE("buffer budget is exceeded, tcp-session[{}] pauses.",
+                        Name());
+    PauseRead();
+    IMPL->budget_paused = true;
+  }
+  if (IMPL->budget_queued) {
+    return;
+  }
+
+  IMPL->budget_queued = true;
+  auto& retry = detail::LocalBudgetRetry(OwnerCycle());
+  retry.sessions.emplace_back(shared_from_this());
+  if (retry.armed) {
+    return;
+  }
+  retry.armed = true;
+  OwnerCycle()->RunAfter(
+      [&retry] {
+        retry.armed = false;
+        std::vector<WPtr<TcpSession>> sessions{};
+        sessions.swap(retry.sessions);
+        for (auto& session : sessions) {
+          auto tcp = session.lock();
+          // retried by `Attach()` if the session was migrated.
+          if (!tcp || !tcp->OwnerCycle()->InCycleThread()) {
+            continue;
+          }
+          auto* impl = d_ptr(tcp->impl_);
+          impl->budget_queued = false;
+          if (!impl->budget_paused || !tcp->Connected()) {
+            continue;
+          }
+          if (impl->in_buffer.Budget()->Exceeded()) {
+            tcp->HandleBudget();
+          } else {
+            impl->budget_paused = false;
+            if (!impl->water_paused) {
+              tcp->StartRead();
+            }
+          }
+        }
+      },
+      BUDGET_RETRY_INTERVAL);
+}
+
+void TcpSession::SendInCycle(const void* _bytes, std::size_t _length) {
+  OwnerCycle()->AssertInCycleThread();
+  IMPL->stream_end += _length;
+  if (CanWriteDirectly() && IMPL->zerocopy_threshold != 0 &&
+      _length >= IMPL->zerocopy_threshold) {
+    // sent by the buffer with MSG_ZEROCOPY.
+    TouchWrite();
+    IMPL->out_buffer.Add(_bytes, _length);
+    WriteDirectly();
+    return;
+  }
+
+  std::size_t written{0};
+  if (CanWriteDirectly()) {
+    // nothing is queued, so try to write directly.
+    TouchWrite();
+    auto write_n = socket_op::Write(Fd(), _bytes, _length);
+    if (write_n > 0) {
+      written = static_cast<std::size_t>(write_n);
+      Account(written, false);
+    } else if (write_n < 0 && errno != EAGAIN && errno != EWOULDBLOCK &&
+               errno != EINTR) {
+      HARE_INTERNAL_TRACE("tcp-session[{}] cannot write directly, detail: {}.",
+                          Name(), io::SocketErrorInfo(Fd()));
+    }
+    if (written == _length) {
+      WriteComplete();
+      return;
+    }
+  }
+
+  auto out_buffer_size = IMPL->out_buffer.Size();
+  IMPL->out_buffer.Add(static_cast<const char*>(_bytes) + written,
+                       _length - written);
+  QueueOutput(out_buffer_size);
+}
+
+void TcpSession::SendVInCycle(const BufferSpan* _spans, std::size_t _count) {
+  OwnerCycle()->AssertInCycleThread();
+  std::size_t total{0};
+  for (std::size_t i = 0; i < _count; ++i) {
+    total += _spans[i].size;
+  }
+  IMPL->stream_end += total;
+  if (CanWriteDirectly() && IMPL->zerocopy_threshold != 0 &&
+      total >= IMPL->zerocopy_threshold) {
+    // sent by the buffer with MSG_ZEROCOPY.
+    TouchWrite();
+    for (std::size_t i = 0; i < _count; ++i) {
+      IMPL->out_buffer.Add(_spans[i].data, _spans[i].size);
+    }
+    WriteDirectly();
+    return;
+  }
+
+  std::size_t written{0};
+#if HARE__HAVE_SYS_UIO_H
+  if (CanWriteDirectly()) {
+    // nothing is queued, so try to write directly.
+    TouchWrite();
+    std::array<struct iovec, MAX_SEND_IOVEC> iov{};
+    auto iov_cnt = Min(_count, iov.size());
+    for (std::size_t i = 0; i < iov_cnt; ++i) {
+      iov[i].iov_base = const_cast<char*>(_spans[i].data);
+      iov[i].iov_len = _spans[i].size;
+    }
+    auto write_n = ::writev(Fd(), iov.data(), static_cast<int>(iov_cnt));
+    if (write_n > 0) {
+      written = static_cast<std::size_t>(write_n);
+      Account(written, false);
+    }
+    if (written == total) {
+      WriteComplete();
+      return;
+    }
+  }
+#endif
+
+  auto out_buffer_size = IMPL->out_buffer.Size();
+  for (std::size_t i = 0; i < _count; ++i) {
+    if (written >= _spans[i].size) {
+      written -= _spans[i].size;
+      continue;
+    }
+    IMPL->out_buffer.Add(_spans[i].data + written, _spans[i].size - written);
+    written = 0;
+  }
+  QueueOutput(out_buffer_size);
+}
+
+void TcpSession::AppendInCycle(Buffer& _buffer) {
+  OwnerCycle()->AssertInCycleThread();
+  IMPL->stream_end += _buffer.Size();
+  if (CanWriteDirectly()) {
+    // nothing is queued, so try to write directly.
+    TouchWrite();
+    IMPL->out_buffer.Append(_buffer);
+    WriteDirectly();
+    return;
+  }
+
+  auto out_buffer_size = IMPL->out_buffer.Size();
+  IMPL->out_buffer.Append(_buffer);
+  QueueOutput(out_buffer_size);
+}
+
+void TcpSession::QueueMessage(std::size_t _queue, Buffer& _buffer,
+                              SendComplete _done) {
+  OwnerCycle()->AssertInCycleThread();
+  if (!detail::HasQueues(IMPL)) {
+    AppendInCycle(_buffer);
+    if (_done) {
+      AddCompletion(std::move(_done));
+    }
+    return;
+  }
+  auto before = PendingOutput();
+  auto direct = CanWriteDirectly();
+  auto& extension = *IMPL->extension;
+  auto& queue = extension.queues[Min(_queue, extension.queues.size() - 1)];
+  queue.messages.emplace_back();
+  queue.messages.back().data.Append(_buffer);
+  queue.messages.back().done = std::move(_done);
+  extension.queued_bytes += queue.messages.back().data.Size();
+  ++extension.queued_messages;
+  if (direct) {
+    // nothing is queued, so try to write directly.
+    TouchWrite();
+    Account(WriteOutput(), false);
+    CheckCompletions();
+    if (PendingOutput() == 0) {
+      WriteComplete();
+    } else {
+      QueueOutput(0);
+    }
+    return;
+  }
+  QueueOutput(before);
+}
+
+void TcpSession::StageOutput() {
+  if (detail::QueuedMessages(IMPL) == 0) {
+    return;
+  }
+  auto& extension = *IMPL->extension;
+  auto& queues = extension.queues;
+  // no more than the kernel would take, the rest can still be reordered.
+  auto stage_size = extension.notsent_lowat != 0
+                        ? Min(std::size_t(extension.notsent_lowat),
+                              std::size_t(OUTPUT_STAGE_SIZE))
+                        : std::size_t(OUTPUT_STAGE_SIZE);
+  while (extension.queued_messages > 0 &&
+         IMPL->out_buffer.Size() < stage_size) {
+    auto* queue = &queues[extension.queue_turn];
+    if (extension.output_policy == OUTPUT_STRICT) {
+      queue = &*std::find_if(queues.begin(), queues.end(),
+                             [](const detail::OutputQueue& _queue) {
+                               return !_queue.messages.empty();
+                             });
+    } else {
+      // deficit round robin, the deficit is refilled on each turn.
+      while (queue->messages.empty() ||
+             queue->deficit < queue->messages.front().data.Size()) {
+        if (queue->messages.empty()) {
+          queue->deficit = 0;
+        }
+        extension.queue_turn = (extension.queue_turn + 1) % queues.size();
+        queue = &queues[extension.queue_turn];
+        if (!queue->messages.empty()) {
+          queue->deficit += queue->weight * OUTPUT_QUANTUM;
+        }
+      }
+    }
+    auto& message = queue->messages.front();
+    auto size = message.data.Size();
+    queue->deficit -= Min(queue->deficit, size);
+    extension.queued_bytes -= size;
+    --extension.queued_messages;
+    IMPL->stream_end += size;
+    IMPL->out_buffer.Append(message.data);
+    if (message.done) {
+      AddCompletion(std::move(message.done));
+    }
+    queue->messages.pop_front();
+  }
+}
+
+auto TcpSession::WriteOutput() -> std::size_t {
+  std::size_t write_n{0};
+  do {
+    StageOutput();
+    auto written = IMPL->out_buffer.Write(Fd());
+    if (written < 0 && errno != EAGAIN && errno != EWOULDBLOCK &&
+        errno != EINTR) {
+      HARE_INTERNAL_ERROR(
+          "an error occurred while writing the socket, detail: {}.",
+          io::SocketErrorInfo(Fd()));
+      HandleError();
+      break;
+    }
+    if (written <= 0) {
+      break;
+    }
+    write_n += static_cast<std::size_t>(written);
+  } while (IMPL->out_buffer.Size() == 0 && detail::QueuedMessages(IMPL) > 0);
+  return write_n;
+}
+
+void TcpSession::WriteDirectly() {
+  Account(WriteOutput(), false);
+  if (PendingOutput() == 0) {
+    WriteComplete();
+  } else {
+    QueueOutput(0);
+  }
+}
+
+auto TcpSession::PendingOutput() const -> std::size_t {
+  return IMPL->out_buffer.Size() + detail::QueuedBytes(IMPL);
+}
+
+auto TcpSession::CanWriteDirectly() -> bool {
+  // the write interest may be left from the connect with nothing pending,
+  // it is dropped by `HandleWrite()`.
+  return !IMPL->corked && !IMPL->auto_cork && PendingOutput() == 0;
+}
+
+void TcpSession::QueueOutput(std::size_t _before) {
+  IMPL->output_peak = Max(IMPL->output_peak, PendingOutput());
+  if (_before == 0) {
+    // the deadline of writing starts when the output is pending.
+    TouchWrite();
+    if (IMPL->write_timeout > 0) {
+      ArmTimeout();
+    }
+  }
+  if (IMPL->auto_cork && !IMPL->corked) {
+    if (!IMPL->flush_queued) {
+      IMPL->flush_queued = true;
+      OwnerCycle()->QueueInCycle(std::bind(
+          [](const WPtr<TcpSession>& session) {
+            auto tcp = session.lock();
+            // re-queued by `Attach()` if the session was migrated.
+            if (tcp && tcp->OwnerCycle()->InCycleThread()) {
+              d_ptr(tcp->impl_)->flush_queued = false;
+              tcp->Flush();
+            }
+          },
+          WPtr<TcpSession>(shared_from_this())));
+    }
+  } else if (!IMPL->corked && !Event()->Writing()) {
+    Event()->EnableWrite();
+  }
+  if (IMPL->high_water_mark != 0 && _before <= IMPL->high_water_mark &&
+      PendingOutput() > IMPL->high_water_mark) {
+    if (IMPL->flow_control) {
+      ThrottleSource(true);
+    }
+    auto callbacks = IMPL->callbacks;
+    if (callbacks->high_water) {
+      callbacks->high_water(shared_from_this());
+    } else if (!IMPL->flow_control) {
+      HARE_INTERNAL_ERROR(
+          "high_water_mark_callback has not been set for tcp-session[{}].",
+          Name());
+    }
+  }
+}
+
+void TcpSession::Flush() {
+  if (IMPL->corked || !Connected() || PendingOutput() == 0 ||
+      Event()->Writing()) {
+    return;
+  }
+  Account(WriteOutput(), false);
+  TouchWrite();
+  CheckCompletions();
+  CheckLowWater();
+  if (PendingOutput() == 0) {
+    WriteComplete();
+  } else {
+    Event()->EnableWrite();
+  }
+}
+
+void TcpSession::WriteComplete() {
+  OwnerCycle()->QueueInCycle(std::bind(
+      [](const WPtr<TcpSession>& session) {
+        auto tcp = session.lock();
+        if (tcp && !tcp->OwnerCycle()->InCycleThread()) {
+          // the session was migrated.
+          tcp->WriteComplete();
+        } else if (tcp) {
+          auto callbacks = d_ptr(tcp->impl_)->callbacks;
+          if (callbacks->write) {
+            callbacks->write(tcp);
+          } else {
+            HARE_INTERNAL_ERROR(
+                "write_callback has not been set for tcp-session[{}].",
+                tcp->Name());
+          }
+        }
+      },
+      WPtr<TcpSession>(shared_from_this())));
+}
+
+void TcpSession::AddCompletion(SendComplete _done) {
+  detail::Extend(IMPL).completions.emplace_back(IMPL->stream_end,
+                                                std::move(_done));
+  CheckCompletions();
+}
+
+void TcpSession::CheckCompletions() {
+  auto* extension = IMPL->extension.get();
+  if (extension == nullptr || extension->completions.empty() ||
+      extension->completion_queued ||
+      extension->completions.front().first >
+          IMPL->stream_end - IMPL->out_buffer.Size()) {
+    return;
+  }
+  // never called back inside `Send()`.
+  extension->completion_queued = true;
+  OwnerCycle()->QueueInCycle(std::bind(
+      [](const WPtr<TcpSession>& session) {
+        auto tcp = session.lock();
+        if (tcp) {
+          tcp->NotifyCompletions();
+        }
+      },
+      WPtr<TcpSession>(shared_from_this())));
+}
+
+void TcpSession::NotifyCompletions() {
+  if (!OwnerCycle()->InCycleThread()) {
+    // the session was migrated.
+    OwnerCycle()->QueueInCycle(std::bind(
+        [](const WPtr<TcpSession>& session) {
+          auto tcp = session.lock();
+          if (tcp) {
+            tcp->NotifyCompletions();
+          }
+        },
+        WPtr<TcpSession>(shared_from_this())));
+    return;
+  }
+  auto& extension = detail::Extend(IMPL);
+  extension.completion_queued = false;
+  auto written = IMPL->stream_end - IMPL->out_buffer.Size();
+  auto& completions = extension.completions;
+  std::size_t count{0};
+  while (count < completions.size() && completions[count].first <= written) {
+    ++count;
+  }
+  auto last = completions.begin() + static_cast<std::ptrdiff_t>(count);
+  decltype(extension.completions) done(
+      std::make_move_iterator(completions.begin()),
+      std::make_move_iterator(last));
+  completions.erase(completions.begin(), last);
+  auto self = shared_from_this();
+  for (auto& completion : done) {
+    completion.second(self, true);
+  }
+}
+
+void TcpSession::PauseRead() {
+  if (IMPL->reading || IMPL->event->Reading()) {
+    IMPL->event->DisableRead();
+    IMPL->reading = false;
+  }
+}
+
+void TcpSession::ThrottleRead(bool _pause) {
+  if (!OwnerCycle()->InCycleThread()) {
+    OwnerCycle()->QueueInCycle(std::bind(
+        [](const WPtr<TcpSession>& session, bool pause) {
+          auto tcp = session.lock();
+          if (tcp) {
+            tcp->ThrottleRead(pause);
+          }
+        },
+        WPtr<TcpSession>(shared_from_this()), _pause));
+    return;
+  }
+  if (_pause) {
+    // don't resume the reading which was stopped by user later.
+    if (!IMPL->water_paused && Connected() &&
+        (IMPL->reading || IMPL->budget_paused)) {
+      HARE_INTERNAL_TRACE("output is over the high water, tcp-session[{}] "
+                          "stops reading.",
+                          Name());
+      PauseRead();
+      IMPL->water_paused = true;
+    }
+  } else if (IMPL->water_paused) {
+    IMPL->water_paused = false;
+    if (!IMPL->budget_paused && Connected()) {
+      StartRead();
+    }
+  }
+}
+
+void TcpSession::ThrottleSource(bool _pause) {
+  IMPL->throttling = _pause;
+  auto source = IMPL->paired ? IMPL->flow_source.lock() : shared_from_this();
+  if (source) {
+    source->ThrottleRead(_pause);
+  }
+}
+
+void TcpSession::CheckLowWater() {
+  if (IMPL->throttling && PendingOutput() <= IMPL->low_water_mark) {
+    ThrottleSource(false);
+  }
+}
+
+void TcpSession::SetTrafficCounter(
+    const Ptr<std::atomic<std::uint64_t>>& _counter) {
+  IMPL->traffic = _counter;
+}
+
+void TcpSession::Account(std::size_t _bytes, bool _read) {
+  if (IMPL->traffic && _bytes > 0) {
+    IMPL->traffic->fetch_add(_bytes, std::memory_order_relaxed);
+  }
+  IMPL->recent_bytes += _bytes;
+  if (_read) {
+    IMPL->bytes_in += _bytes;
+    ++IMPL->reads;
+  } else if (_bytes > 0) {
+    IMPL->bytes_out += _bytes;
+    ++IMPL->writes;
+  }
+}
+
+void TcpSession::SampleInfo() {
+  auto& extension = detail::Extend(IMPL);
+  if (IMPL->socket.GetTcpInfo(extension.tcp_info)) {
+    extension.info_time = Timestamp::Now();
+  }
+  extension.kernel_queued = IMPL->socket.KernelQueued();
+  extension.kernel_unsent = IMPL->socket.KernelUnsent();
+}
+
+void TcpSession::ArmSampling() {
+  if (!IMPL->extension) {
+    return;
+  }
+  auto generation = ++IMPL->extension->info_generation;
+  if (IMPL->extension->info_interval <= 0 || !Connected()) {
+    return;
+  }
+  OwnerCycle()->RunAfter(
+      std::bind(
+          [generation](const WPtr<TcpSession>& session) {
+            auto tcp = session.lock();
+            // re-armed by `Attach()` if the session was migrated.
+            if (!tcp || !tcp->OwnerCycle()->InCycleThread() ||
+                d_ptr(tcp->impl_)->extension->info_generation !=
+                    generation ||
+                !tcp->Connected()) {
+              return;
+            }
+            tcp->SampleInfo();
+            tcp->ArmSampling();
+          },
+          WPtr<TcpSession>(shared_from_this())),
+      IMPL->extension->info_interval);
+}
+
+auto TcpSession::TakeRecentBytes() -> std::uint64_t {
+  auto bytes = IMPL->recent_bytes;
+  IMPL->recent_bytes = 0;
+  return bytes;
+}
+
+auto TcpSession::MutableCallbacks() -> Callbacks& {
+  if (!IMPL->own_callbacks || IMPL->callbacks.use_count() != 1) {
+    IMPL->callbacks = std::make_shared<Callbacks>(*IMPL->callbacks);
+    IMPL->own_callbacks = true;
+  }
+  // created by this session as non-const.
+  return const_cast<Callbacks&>(*IMPL->callbacks);
+}
+
+void TcpSession::SetIdleRelease(std::int64_t _idle) {
+  IMPL->idle_release = _idle;
+}
+
+void TcpSession::TouchWrite() {
+  IMPL->last_write =
+      OwnerCycle()->ReactorReturnTime().microseconds_since_epoch();
+  RearmRelease();
+}
+
+void TcpSession::RearmRelease() {
+  if (IMPL->idle_released) {
+    // the buffers may hold memory again.
+    IMPL->idle_released = false;
+    ArmTimeout();
+  }
+}
+
+namespace detail {
+// when the buffers are freed if the session stays idle, 0 if never.
+static auto ReleaseDeadline(const TcpSessionImpl* _impl) -> std::int64_t {
+  if (_impl->idle_release <= 0 || _impl->idle_released) {
+    return 0;
+  }
+  return Max(Max(_impl->last_read, _impl->last_write),
+             _impl->release_since) +
+         _impl->idle_release;
+}
+
+// the earliest deadline after `_now`, or the expired one in `_reason`.
+static auto NextDeadline(const TcpSessionImpl* _impl, std::int64_t _now,
+                         SessionTimeout& _reason) -> std::int64_t {
+  std::int64_t next{0};
+  auto check = [&](std::int64_t _timeout, std::int64_t _since,
+                   SessionTimeout _which) {
+    if (_timeout <= 0 || _reason != TIMEOUT_NONE) {
+      return;
+    }
+    auto deadline = _since + _timeout;
+    if (deadline <= _now) {
+      _reason = _which;
+    } else if (next == 0 || deadline < next) {
+      next = deadline;
+    }
+  };
+  check(_impl->idle_timeout, Max(_impl->last_read, _impl->last_write),
+        TIMEOUT_IDLE);
+  if (_impl->reading) {
+    check(_impl->read_timeout, _impl->last_read, TIMEOUT_READ);
+  }
+  if (_impl->out_buffer.Size() + QueuedBytes(_impl) > 0) {
+    check(_impl->write_timeout, _impl->last_write, TIMEOUT_WRITE);
+  }
+  auto release = ReleaseDeadline(_impl);
+  if (release > 0 && (next == 0 || release < next)) {
+    next = Max(release, _now);
+  }
+  return next;
+}
+}  // namespace detail
+
+void TcpSession::ArmTimeout() {
+  if (!OwnerCycle()->InCycleThread()) {
+    OwnerCycle()->QueueInCycle(std::bind(
+        [](const WPtr<TcpSession>& session) {
+          auto tcp = session.lock();
+          if (tcp) {
+            tcp->ArmTimeout();
+          }
+        },
+        WPtr<TcpSession>(shared_from_this())));
+    return;
+  }
+  if (!Connected()) {
+    // armed by `ConnectEstablished()`.
+    return;
+  }
+  auto now = Timestamp::Now().microseconds_since_epoch();
+  SessionTimeout reason{TIMEOUT_NONE};
+  auto next = detail::NextDeadline(IMPL, now, reason);
+  if (reason != TIMEOUT_NONE) {
+    // closed by the next tick, not in the middle of callbacks.
+    next = now;
+  }
+  if (next > 0) {
+    TimingWheel::Local(OwnerCycle()).Add(shared_from_this(), next);
+  }
+}
+
+auto TcpSession::CheckTimeout(std::int64_t _now) -> std::int64_t {
+  if (!Connected()) {
+    return 0;
+  }
+  ReleaseIdle(_now);
+  SessionTimeout reason{TIMEOUT_NONE};
+  auto next = detail::NextDeadline(IMPL, _now, reason);
+  if (reason != TIMEOUT_NONE) {
+    HARE_INTERNAL_TRACE("tcp-session[{}] timed out, reason: {}.", Name(),
+                        detail::TimeoutToString(reason));
+    IMPL->timeout_reason = reason;
+    HandleClose();
+    return 0;
+  }
+  return next;
+}
+
+void TcpSession::ReleaseIdle(std::int64_t _now) {
+  auto deadline = detail::ReleaseDeadline(IMPL);
+  if (deadline == 0 || deadline > _now) {
+    return;
+  }
+  if (IMPL->in_buffer.Size() == 0 && PendingOutput() == 0) {
+    IMPL->in_buffer.ShrinkToFit();
+    IMPL->out_buffer.ShrinkToFit();
+    IMPL->idle_released = true;
+  } else {
+    // checked again after another period.
+    IMPL->release_since = _now;
+  }
+}
+
+auto TcpSession::WheelDeadline() const -> std::int64_t {
+  return IMPL->wheel_deadline;
+}
+void TcpSession::SetWheelDeadline(std::int64_t _deadline) {
+  IMPL->wheel_deadline = _deadline;
+}
+
+void TcpSession::Detach(io::Cycle* _cycle) {
+  OwnerCycle()->AssertInCycleThread();
+  HARE_ASSERT(Connected());
+  // the interests are kept in the event, and restored by `Attach()`.
+  OwnerCycle()->EventRemove(IMPL->event);
+  IMPL->cycle = CHECK_NULL(_cycle);
+}
+
+void TcpSession::Attach() {
+  OwnerCycle()->AssertInCycleThread();
+  if (!Connected()) {
+    return;
+  }
+  OwnerCycle()->EventUpdate(IMPL->event);
+  if (!IMPL->corked && !IMPL->auto_cork && PendingOutput() > 0 &&
+      !Event()->Writing()) {
+    Event()->EnableWrite();
+  }
+
+  // tasks left in the previous cycle are dropped, so they are redone here.
+  IMPL->wheel_deadline = 0;
+  ArmTimeout();
+  if (IMPL->budget_paused) {
+    IMPL->budget_queued = false;
+    HandleBudget();
+  }
+  if (IMPL->flush_queued) {
+    IMPL->flush_queued = false;
+    QueueOutput(PendingOutput());
+  }
+  ArmSampling();
+}
+
 void TcpSession::ConnectEstablished() {
   HARE_ASSERT(IMPL->state == STATE_CONNECTING);
   SetState(STATE_CONNECTED);
-  if (IMPL->connect) {
-    IMPL->connect(shared_from_this(), SESSION_CONNECTED);
+  auto callbacks = IMPL->callbacks;
+  if (callbacks->connect) {
+    callbacks->connect(shared_from_this(), SESSION_CONNECTED);
   } else {
     HARE_INTERNAL_ERROR(
         "connect_callback has not been set for session[{}], session connected.",
-        IMPL->name);
+        Name());
   }
   IMPL->event->Tie(shared_from_this());
-  IMPL->cycle->EventUpdate(IMPL->event);
+  OwnerCycle()->EventUpdate(IMPL->event);
   IMPL->event->EnableRead();
+  IMPL->reading = true;
+
+  IMPL->last_read = Timestamp::Now().microseconds_since_epoch();
+  IMPL->last_write = IMPL->last_read;
+  if (IMPL->idle_timeout > 0 || IMPL->read_timeout > 0 ||
+      IMPL->idle_release > 0) {
+    ArmTimeout();
+  }
+  if (IMPL->extension && IMPL->extension->info_interval > 0) {
+    SampleInfo();
+    ArmSampling();
+  }
 }
 
 }  // namespace net
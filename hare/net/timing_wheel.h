@@ -0,0 +1,144 @@
+#ifndef _HARE_NET_TIMING_WHEEL_H_
+#define _HARE_NET_TIMING_WHEEL_H_
+
+#include <hare/base/io/cycle.h>
+#include <hare/base/time/timestamp.h>
+#include <hare/net/tcp/session.h>
+
+#include <vector>
+
+#include "base/fwd-inl.h"
+
+// the span of wheel is 60s, later deadlines are checked once per span.
+#define TIMING_WHEEL_TICK (100 * 1000)
+#define TIMING_WHEEL_SLOTS 600
+
+namespace hare {
+namespace net {
+
+/**
+ * @brief The deadlines of sessions in one cycle are serviced by a hashed
+ *   wheel ticked by one timer of the cycle. Sessions only record the time
+ *   of activity, and are checked lazily when their slot expires, then they
+ *   are rescheduled to the next deadline.
+ *
+ *   `Session` provides `OwnerCycle()`, `WheelDeadline()`,
+ *   `SetWheelDeadline()` and `CheckTimeout()` like `TcpSession`.
+ **/
+template <typename Session>
+class BasicTimingWheel : public util::NonCopyable {
+  struct Entry {
+    WPtr<Session> session;
+    std::int64_t deadline;
+  };
+  using Slot = std::vector<Entry>;
+
+  io::Cycle* cycle_{nullptr};
+  io::Event::Id timer_id_{-1};
+  std::int64_t tick_{TIMING_WHEEL_TICK};
+  std::vector<Slot> slots_;
+  std::size_t current_{0};
+  std::size_t size_{0};
+
+ public:
+  explicit BasicTimingWheel(io::Cycle* _cycle = nullptr,
+                            std::int64_t _tick = TIMING_WHEEL_TICK,
+                            std::size_t _slots = TIMING_WHEEL_SLOTS)
+      : cycle_(_cycle), tick_(_tick), slots_(Max(_slots, std::size_t(2))) {}
+
+  /**
+   * @brief The wheel of current thread, it is bound to `_cycle`.
+   **/
+  static auto Local(io::Cycle* _cycle) -> BasicTimingWheel&;
+
+  HARE_INLINE auto size() const -> std::size_t { return size_; }
+
+  /**
+   * @brief Schedules the session at `_deadline` (us since epoch), the
+   *   entry is ignored if it is scheduled earlier already.
+   **/
+  void Add(const Ptr<Session>& _session, std::int64_t _deadline);
+
+ private:
+  void Tick();
+};
+
+using TimingWheel = BasicTimingWheel<TcpSession>;
+
+template <typename Session>
+auto BasicTimingWheel<Session>::Local(io::Cycle* _cycle)
+    -> BasicTimingWheel& {
+  static thread_local BasicTimingWheel wheel{};
+  if (wheel.cycle_ != _cycle) {
+    // the cycle of thread was replaced, drops the old one.
+    std::vector<Slot>(wheel.slots_.size()).swap(wheel.slots_);
+    wheel.cycle_ = _cycle;
+    wheel.timer_id_ = -1;
+    wheel.current_ = 0;
+    wheel.size_ = 0;
+  }
+  return wheel;
+}
+
+template <typename Session>
+void BasicTimingWheel<Session>::Add(const Ptr<Session>& _session,
+                                    std::int64_t _deadline) {
+  HARE_ASSERT(cycle_ != nullptr);
+  cycle_->AssertInCycleThread();
+  auto scheduled = _session->WheelDeadline();
+  if (scheduled != 0 && scheduled <= _deadline) {
+    return;
+  }
+
+  auto delay = _deadline - Timestamp::Now().microseconds_since_epoch();
+  auto ticks = delay <= 0 ? 1
+                          : static_cast<std::size_t>(
+                                (delay + tick_ - 1) / tick_);
+  ticks = Max(Min(ticks, slots_.size() - 1), static_cast<std::size_t>(1));
+  slots_[(current_ + ticks) % slots_.size()].push_back(
+      Entry{_session, _deadline});
+  _session->SetWheelDeadline(_deadline);
+  ++size_;
+
+  if (timer_id_ == -1) {
+    timer_id_ =
+        cycle_->RunEvery(std::bind(&BasicTimingWheel::Tick, this), tick_);
+  }
+}
+
+template <typename Session>
+void BasicTimingWheel<Session>::Tick() {
+  current_ = (current_ + 1) % slots_.size();
+  Slot expired{};
+  expired.swap(slots_[current_]);
+  size_ -= expired.size();
+
+  auto now = Timestamp::Now().microseconds_since_epoch();
+  for (auto& entry : expired) {
+    auto session = entry.session.lock();
+    // the entry is stale if the session was rescheduled earlier, or
+    // migrated to another cycle.
+    if (!session || session->OwnerCycle() != cycle_ ||
+        session->WheelDeadline() != entry.deadline) {
+      continue;
+    }
+    session->SetWheelDeadline(0);
+    auto next = session->CheckTimeout(now);
+    if (next > 0) {
+      Add(session, next);
+    }
+  }
+
+  if (size_ == 0 && timer_id_ != -1) {
+    // the timer cannot be cancelled while it is being handled.
+    auto* cycle = cycle_;
+    auto id = timer_id_;
+    timer_id_ = -1;
+    cycle->QueueInCycle([cycle, id] { cycle->Cancel(id); });
+  }
+}
+
+}  // namespace net
+}  // namespace hare
+
+#endif  // _HARE_NET_TIMING_WHEEL_H_
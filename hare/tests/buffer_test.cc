@@ -1,6 +1,22 @@
 #include <gtest/gtest.h>
+#include <hare/base/io/operation.h>
 #include <hare/net/buffer.h>
 
+#include <array>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <string>
+#include <type_traits>
+
+#if defined(H_OS_UNIX)
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
 #define FMT_HEADER_ONLY 1
 #include <fmt/format.h>
 
@@ -56,6 +72,519 @@ TEST(BufferTest, testAppend) {
              test_buffer1.ChainSize());
 }
 
+TEST(BufferTest, testCodec) {
+  using hare::net::Buffer;
+  Buffer test_buffer{};
+
+  ASSERT_TRUE(test_buffer.AddInt8(0x01));
+  ASSERT_TRUE(test_buffer.AddInt16(0x0203));
+  ASSERT_TRUE(test_buffer.AddInt32(0x04050607, hare::net::ENDIAN_LITTLE));
+  ASSERT_TRUE(test_buffer.AddInt64(0x08090a0b0c0d0e0fULL));
+  ASSERT_EQ(test_buffer.Size(), 15);
+
+  std::array<std::uint8_t, 7> head{};
+  ASSERT_EQ(test_buffer.Peek(head.data(), head.size()), head.size());
+  ASSERT_EQ(head, (std::array<std::uint8_t, 7>{1, 2, 3, 7, 6, 5, 4}));
+  ASSERT_EQ(test_buffer.Size(), 15);
+
+  std::uint8_t u8{};
+  std::uint16_t u16{};
+  std::uint32_t u32{};
+  std::uint64_t u64{};
+  ASSERT_TRUE(test_buffer.ReadInt8(u8));
+  ASSERT_TRUE(test_buffer.ReadInt16(u16));
+  ASSERT_TRUE(test_buffer.ReadInt32(u32, hare::net::ENDIAN_LITTLE));
+  ASSERT_TRUE(test_buffer.PeekInt64(u64));
+  ASSERT_EQ(u8, 0x01);
+  ASSERT_EQ(u16, 0x0203);
+  ASSERT_EQ(u32, 0x04050607);
+  ASSERT_EQ(u64, 0x08090a0b0c0d0e0fULL);
+  test_buffer.Skip(7);
+  ASSERT_FALSE(test_buffer.ReadInt64(u64));
+  ASSERT_EQ(test_buffer.Size(), 1);
+  test_buffer.ClearAll();
+
+  for (auto value : {std::uint64_t(0), std::uint64_t(127), std::uint64_t(300),
+                     std::uint64_t(-1)}) {
+    ASSERT_TRUE(test_buffer.AddVarint(value));
+    ASSERT_GT(test_buffer.ReadVarint(u64), 0);
+    ASSERT_EQ(u64, value);
+  }
+  ASSERT_TRUE(test_buffer.AddInt8(0x80));
+  ASSERT_EQ(test_buffer.PeekVarint(u64), 0);
+  test_buffer.ClearAll();
+  // the tenth byte overflows 64 bits.
+  for (auto i = 0; i < 9; ++i) {
+    ASSERT_TRUE(test_buffer.AddInt8(0xff));
+  }
+  ASSERT_TRUE(test_buffer.AddInt8(0x02));
+  ASSERT_EQ(test_buffer.PeekVarint(u64), -1);
+  ASSERT_EQ(test_buffer.ReadVarint(u64), -1);
+  ASSERT_EQ(test_buffer.Size(), 10);
+  test_buffer.ClearAll();
+
+  // the prefix of the second frame crosses the boundary of blocks.
+  std::string payload(0x1000, 'x');
+  Buffer other{};
+  ASSERT_TRUE(test_buffer.AddFrame(payload.data(), payload.size() - 2,
+                                   hare::net::FRAME_PREFIX_16));
+  ASSERT_TRUE(test_buffer.AddInt8(0x00));
+  ASSERT_TRUE(other.AddInt8(0x03));
+  ASSERT_TRUE(other.Add("abc", 3));
+  ASSERT_TRUE(other.AddFrame("de", 2, hare::net::FRAME_PREFIX_VARINT));
+  test_buffer.Append(other);
+  ASSERT_GT(test_buffer.ChainSize(), 1);
+
+  Buffer frame{};
+  std::string received(payload.size(), '\0');
+  ASSERT_EQ(test_buffer.ReadFrame(frame, hare::net::FRAME_PREFIX_16), 1);
+  ASSERT_EQ(frame.Remove(&received[0], received.size()), payload.size() - 2);
+  ASSERT_EQ(test_buffer.ReadFrame(frame, hare::net::FRAME_PREFIX_16), 1);
+  ASSERT_EQ(frame.Remove(&received[0], received.size()), 3);
+  ASSERT_EQ(received.substr(0, 3), "abc");
+
+  // a frame is never read into its own buffer.
+  ASSERT_EQ(test_buffer.ReadFrame(test_buffer, hare::net::FRAME_PREFIX_VARINT),
+            -1);
+  ASSERT_EQ(test_buffer.Size(), 3);
+
+  std::size_t header{};
+  std::size_t length{};
+  test_buffer.Skip(1);
+  ASSERT_EQ(test_buffer.PeekFrame(header, length,
+                                  hare::net::FRAME_PREFIX_VARINT),
+            0);
+}
+
+TEST(BufferTest, testBudget) {
+  using hare::net::Buffer;
+  using hare::net::BufferBudget;
+
+  auto global_usage = BufferBudget::Global()->Usage();
+  auto budget = std::make_shared<BufferBudget>(0x2000);
+  ASSERT_EQ(budget->Parent(), BufferBudget::Global());
+
+  {
+    Buffer test_buffer{};
+    test_buffer.SetBudget(budget);
+    std::string data(0x1000, 'x');
+    ASSERT_TRUE(test_buffer.Add(data.data(), data.size()));
+    ASSERT_FALSE(budget->Exceeded());
+    ASSERT_TRUE(test_buffer.Add(data.data(), data.size()));
+    ASSERT_TRUE(test_buffer.Add(data.data(), data.size()));
+    ASSERT_TRUE(budget->Exceeded());
+    ASSERT_GE(budget->Usage(), 3 * data.size());
+    ASSERT_EQ(BufferBudget::Global()->Usage() - global_usage, budget->Usage());
+
+    // the blocks are still charged to the budget after moved.
+    Buffer other{};
+    other.Append(test_buffer);
+    ASSERT_GE(budget->Usage(), 3 * data.size());
+    other.ClearAll();
+    ASSERT_FALSE(budget->Exceeded());
+  }
+  ASSERT_EQ(budget->Usage(), 0);
+  ASSERT_EQ(BufferBudget::Global()->Usage(), global_usage);
+}
+
+TEST(BufferTest, testShrinkToFit) {
+  using hare::net::Buffer;
+  using hare::net::BufferBudget;
+
+  auto budget = std::make_shared<BufferBudget>();
+  Buffer test_buffer{};
+  test_buffer.SetBudget(budget);
+  std::string data(0x1000, 'x');
+  for (auto i = 0; i < 4; ++i) {
+    ASSERT_TRUE(test_buffer.Add(data.data(), data.size()));
+  }
+  test_buffer.Skip(3 * data.size() + 1);
+  test_buffer.ShrinkToFit();
+  ASSERT_EQ(test_buffer.Size(), data.size() - 1);
+  ASSERT_LT(budget->Usage(), 2 * data.size());
+
+  // the spare blocks are freed, and then the last one.
+  test_buffer.ClearAll();
+  ASSERT_GT(budget->Usage(), 0);
+  test_buffer.ShrinkToFit();
+  ASSERT_EQ(budget->Usage(), 0);
+  ASSERT_EQ(test_buffer.ChainSize(), 1);
+
+  ASSERT_TRUE(test_buffer.Add(data.data(), data.size()));
+  ASSERT_EQ(test_buffer.Size(), data.size());
+}
+
+TEST(BufferTest, testTrimPolicy) {
+  using hare::net::Buffer;
+  using hare::net::BufferBudget;
+
+  auto budget = std::make_shared<BufferBudget>();
+  std::string data(0x1000, 'x');
+  {
+    Buffer test_buffer{};
+    test_buffer.SetBudget(budget);
+    test_buffer.SetTrimPolicy(2 * data.size(), 0);
+    for (auto i = 0; i < 8; ++i) {
+      ASSERT_TRUE(test_buffer.Add(data.data(), data.size()));
+    }
+    test_buffer.Skip(7 * data.size());
+    ASSERT_EQ(test_buffer.Size(), data.size());
+    ASSERT_LE(budget->Usage(), 3 * data.size());
+  }
+  ASSERT_EQ(budget->Usage(), 0);
+
+  // released after two drain rounds left it empty.
+  Buffer test_buffer{};
+  test_buffer.SetBudget(budget);
+  test_buffer.SetTrimPolicy(0, 2);
+  ASSERT_TRUE(test_buffer.Add(data.data(), data.size()));
+  test_buffer.Skip(data.size());
+  ASSERT_GT(budget->Usage(), 0);
+  ASSERT_TRUE(test_buffer.Add(data.data(), data.size()));
+  test_buffer.Skip(data.size());
+  ASSERT_EQ(budget->Usage(), 0);
+
+  // falls back to plain allocations without a pool.
+  Buffer::SetBlockPool(0);
+  ASSERT_TRUE(test_buffer.Add(data.data(), data.size()));
+  ASSERT_EQ(test_buffer.Size(), data.size());
+  Buffer::SetBlockPool(0x100000);
+}
+
+TEST(BufferTest, testCursor) {
+  using hare::net::Buffer;
+  using hare::net::BufferCursor;
+  static_assert(std::is_trivially_copyable<BufferCursor>::value,
+                "BufferCursor must be trivially copyable.");
+
+  Buffer test_buffer{};
+  ASSERT_FALSE(test_buffer.Cursor().Valid());
+
+  std::string expected{};
+  for (auto i = 0; i < 3; ++i) {
+    Buffer other{};
+    std::string data(0x1000 + i, static_cast<char>('a' + i));
+    ASSERT_TRUE(other.Add(data.data(), data.size()));
+    test_buffer.Append(other);
+    expected += data;
+  }
+  ASSERT_EQ(test_buffer.ChainSize(), 3);
+
+  std::string received{};
+  for (auto cursor = test_buffer.Cursor(); cursor.Valid(); ++cursor) {
+    received.push_back(*cursor);
+  }
+  ASSERT_EQ(received, expected);
+
+  received.clear();
+  auto cursor = test_buffer.Cursor();
+  do {
+    auto span = cursor.Span();
+    received.append(span.data, span.size);
+  } while (cursor.NextSegment());
+  ASSERT_EQ(received, expected);
+  ASSERT_EQ(cursor.Offset(), expected.size());
+
+  cursor = test_buffer.Cursor();
+  ASSERT_EQ(cursor[0x1000], 'b');
+  ASSERT_EQ(cursor.At(expected.size() - 1), 'c');
+  ASSERT_EQ(cursor.At(expected.size()), '\0');
+  cursor += 0x2001;
+  ASSERT_EQ(cursor.Offset(), 0x2001);
+  ASSERT_EQ(*cursor, 'c');
+  ASSERT_TRUE(cursor.Seek(0x0fff));
+  ASSERT_EQ(*++cursor, 'b');
+  ASSERT_FALSE(cursor.Seek(expected.size() + 1));
+  ASSERT_FALSE(cursor.Valid());
+}
+
+#if defined(H_OS_UNIX)
+TEST(BufferTest, testAddFile) {
+  using hare::net::Buffer;
+  Buffer test_buffer{};
+
+  const std::string head{"head:"};
+  const std::string body{"0123456789abcdefghijklmnopqrstuvwxyz"};
+  const std::string tail{":tail"};
+
+  auto* file = std::tmpfile();
+  ASSERT_NE(file, nullptr);
+  ASSERT_EQ(std::fwrite(body.data(), 1, body.size(), file), body.size());
+  ASSERT_EQ(std::fflush(file), 0);
+
+  // [head][file: body[10, 36)][tail][file: body[0, 10)]
+  test_buffer.Add(head.data(), head.size());
+  ASSERT_TRUE(test_buffer.AddFile(::fileno(file), 10, body.size() - 10));
+  test_buffer.Add(tail.data(), tail.size());
+  ASSERT_TRUE(test_buffer.AddFile(::fileno(file), 0, 10));
+
+  const auto expected = head + body.substr(10) + tail + body.substr(0, 10);
+  ASSERT_EQ(test_buffer.Size(), expected.size());
+
+  hare::util_socket_t fds[2];
+  ASSERT_EQ(hare::io::Socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+
+  // the first part is removed by copying.
+  std::string removed(8, '\0');
+  ASSERT_EQ(test_buffer.Remove(&removed[0], removed.size()), removed.size());
+  ASSERT_EQ(removed, expected.substr(0, removed.size()));
+
+  ASSERT_EQ(test_buffer.Write(fds[0]),
+            static_cast<std::int64_t>(expected.size() - removed.size()));
+  ASSERT_EQ(test_buffer.Size(), 0);
+
+  std::string received(expected.size() - removed.size(), '\0');
+  ASSERT_EQ(::read(fds[1], &received[0], received.size()),
+            static_cast<ssize_t>(received.size()));
+  ASSERT_EQ(received, expected.substr(removed.size()));
+
+  // the segment is longer than the file, the rest is dropped with EIO.
+  ASSERT_TRUE(test_buffer.AddFile(::fileno(file), 0, body.size() + 16));
+  ASSERT_EQ(test_buffer.Write(fds[0]),
+            static_cast<std::int64_t>(body.size()));
+  ASSERT_EQ(test_buffer.Write(fds[0]), -1);
+  ASSERT_EQ(errno, EIO);
+  ASSERT_EQ(test_buffer.Size(), 0);
+
+  // a frame that does not fit leaves no prefix behind.
+  const std::size_t limit{0xffffffff};
+  ASSERT_TRUE(test_buffer.AddFile(::fileno(file), 0, limit - 8));
+  ASSERT_FALSE(test_buffer.AddFrame(body.data(), 8));
+  ASSERT_EQ(test_buffer.Size(), limit - 8);
+  test_buffer.Skip(test_buffer.Size());
+
+  ::close(fds[0]);
+  ::close(fds[1]);
+  hare::IgnoreUnused(std::fclose(file));
+}
+
+TEST(BufferTest, testSpill) {
+  using hare::net::Buffer;
+  using hare::net::BufferBudget;
+
+  auto budget = std::make_shared<BufferBudget>();
+  Buffer test_buffer{};
+  test_buffer.SetBudget(budget);
+  test_buffer.SetSpill(0x1000);
+
+  std::string expected{};
+  auto add = [&](std::size_t _size, char _byte) {
+    std::string data(_size, _byte);
+    ASSERT_TRUE(test_buffer.Add(data.data(), data.size()));
+    expected += data;
+  };
+  add(0x1000, 'a');
+  ASSERT_EQ(test_buffer.Spilled(), 0);
+  add(0x2000, 'b');
+  add(0x100, 'c');
+  Buffer other{};
+  std::string tail(0x100, 'd');
+  ASSERT_TRUE(other.Add(tail.data(), tail.size()));
+  test_buffer.Append(other);
+  expected += tail;
+
+  ASSERT_EQ(other.Size(), 0);
+  ASSERT_EQ(test_buffer.Size(), expected.size());
+  ASSERT_EQ(test_buffer.Spilled(), expected.size() - 0x1000);
+  // the spilled part extends one segment, and is not charged.
+  ASSERT_EQ(test_buffer.ChainSize(), 2);
+  ASSERT_LT(budget->Usage(), 0x2000);
+
+  hare::util_socket_t fds[2];
+  ASSERT_EQ(hare::io::Socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+  ASSERT_EQ(test_buffer.Write(fds[0]),
+            static_cast<std::int64_t>(expected.size()));
+  ASSERT_EQ(test_buffer.Spilled(), 0);
+
+  std::string received(expected.size(), '\0');
+  std::size_t total{0};
+  while (total < received.size()) {
+    auto read_n = ::read(fds[1], &received[total], received.size() - total);
+    ASSERT_GT(read_n, 0);
+    total += static_cast<std::size_t>(read_n);
+  }
+  ASSERT_EQ(received, expected);
+
+  ::close(fds[0]);
+  ::close(fds[1]);
+}
+
+TEST(BufferTest, testReadSpill) {
+  using hare::net::Buffer;
+  Buffer test_buffer{};
+
+  hare::util_socket_t fds[2];
+  ASSERT_EQ(hare::io::Socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+
+  std::string sent(0x8000, '\0');
+  for (std::size_t i = 0; i < sent.size(); ++i) {
+    sent[i] = static_cast<char>('a' + i % 26);
+  }
+  ASSERT_EQ(::write(fds[0], sent.data(), sent.size()),
+            static_cast<ssize_t>(sent.size()));
+
+  // more than the learned size is read by one call.
+  ASSERT_EQ(test_buffer.Read(fds[1]), static_cast<std::int64_t>(sent.size()));
+  ASSERT_EQ(test_buffer.Size(), sent.size());
+
+  std::string received(sent.size(), '\0');
+  ASSERT_EQ(test_buffer.Remove(&received[0], received.size()), sent.size());
+  ASSERT_EQ(received, sent);
+
+  ::close(fds[0]);
+  ASSERT_EQ(test_buffer.Read(fds[1]), 0);
+  ::close(fds[1]);
+}
+
+TEST(BufferTest, testReadGrowth) {
+  using hare::net::Buffer;
+  Buffer test_buffer{};
+
+  hare::util_socket_t fds[2];
+  ASSERT_EQ(hare::io::Socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+
+  // the learned size outgrows the drained block, so blocks are added.
+  std::string sent(0x1000, 'a');
+  std::string received(sent.size(), '\0');
+  for (auto i = 0; i < 4; ++i) {
+    ASSERT_EQ(::write(fds[0], sent.data(), sent.size()),
+              static_cast<ssize_t>(sent.size()));
+    ASSERT_EQ(test_buffer.Read(fds[1]),
+              static_cast<std::int64_t>(sent.size()));
+    ASSERT_EQ(test_buffer.Remove(&received[0], received.size()), sent.size());
+    ASSERT_EQ(received, sent);
+  }
+
+  ::close(fds[0]);
+  ::close(fds[1]);
+}
+
+#if defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+TEST(BufferTest, testZeroCopy) {
+  using hare::net::Buffer;
+
+  struct sockaddr_in addr {};
+  socklen_t addr_len = sizeof(addr);
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  auto listen_fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  ASSERT_GE(listen_fd, 0);
+  ASSERT_EQ(::bind(listen_fd, (struct sockaddr*)&addr, addr_len), 0);
+  ASSERT_EQ(::listen(listen_fd, 1), 0);
+  ASSERT_EQ(::getsockname(listen_fd, (struct sockaddr*)&addr, &addr_len), 0);
+
+  auto send_fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  ASSERT_EQ(::connect(send_fd, (struct sockaddr*)&addr, addr_len), 0);
+  auto recv_fd = ::accept(listen_fd, nullptr, nullptr);
+  ASSERT_GE(recv_fd, 0);
+
+  auto opt_val{1};
+  if (::setsockopt(send_fd, SOL_SOCKET, SO_ZEROCOPY, &opt_val,
+                   sizeof(opt_val)) == 0) {
+    std::string sent(0x10000, '\0');
+    for (std::size_t i = 0; i < sent.size(); ++i) {
+      sent[i] = static_cast<char>('a' + i % 26);
+    }
+
+    Buffer test_buffer{};
+    test_buffer.SetZeroCopy(0x1000);
+    ASSERT_TRUE(test_buffer.Add(sent.data(), sent.size()));
+    ASSERT_EQ(test_buffer.Write(send_fd),
+              static_cast<std::int64_t>(sent.size()));
+    ASSERT_EQ(test_buffer.Size(), 0);
+    ASSERT_EQ(test_buffer.ZeroCopyPending(), 1);
+
+    // the block partly sent is still pinned, so it is copied by appending.
+    constexpr std::size_t partial = 0x1800;
+    ASSERT_TRUE(test_buffer.Add(sent.data(), sent.size()));
+    ASSERT_EQ(test_buffer.Write(send_fd, partial),
+              static_cast<std::int64_t>(partial));
+    ASSERT_EQ(test_buffer.ZeroCopyPending(), 2);
+    Buffer other{};
+    other.Append(test_buffer);
+    ASSERT_EQ(test_buffer.Size(), 0);
+    ASSERT_EQ(test_buffer.ZeroCopyPending(), 2);
+    std::string rest(sent.size() - partial, '\0');
+    ASSERT_EQ(other.Remove(&rest[0], rest.size()), rest.size());
+    ASSERT_EQ(rest, sent.substr(partial));
+
+    const auto expected = sent + sent.substr(0, partial);
+    std::string received{};
+    std::string cache(expected.size(), '\0');
+    while (received.size() < expected.size()) {
+      auto read_n = ::read(recv_fd, &cache[0], cache.size());
+      ASSERT_GT(read_n, 0);
+      received.append(cache.data(), static_cast<std::size_t>(read_n));
+    }
+    ASSERT_EQ(received, expected);
+
+    // the completions are notified as POLLERR.
+    struct pollfd pfd {};
+    pfd.fd = send_fd;
+    for (auto i = 0; i < 10 && test_buffer.ZeroCopyPending() > 0; ++i) {
+      ASSERT_EQ(::poll(&pfd, 1, 1000), 1);
+      test_buffer.ReapZeroCopy(send_fd);
+    }
+    ASSERT_EQ(test_buffer.ZeroCopyPending(), 0);
+  }
+
+  ::close(send_fd);
+  ::close(recv_fd);
+  ::close(listen_fd);
+}
+
+TEST(BufferTest, testZeroCopyPeerClosed) {
+  using hare::net::Buffer;
+
+  struct sockaddr_in addr {};
+  socklen_t addr_len = sizeof(addr);
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  auto listen_fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  ASSERT_GE(listen_fd, 0);
+  ASSERT_EQ(::bind(listen_fd, (struct sockaddr*)&addr, addr_len), 0);
+  ASSERT_EQ(::listen(listen_fd, 1), 0);
+  ASSERT_EQ(::getsockname(listen_fd, (struct sockaddr*)&addr, &addr_len), 0);
+
+  auto send_fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  ASSERT_EQ(::connect(send_fd, (struct sockaddr*)&addr, addr_len), 0);
+  auto recv_fd = ::accept(listen_fd, nullptr, nullptr);
+  ASSERT_GE(recv_fd, 0);
+
+  auto opt_val{1};
+  if (::setsockopt(send_fd, SOL_SOCKET, SO_ZEROCOPY, &opt_val,
+                   sizeof(opt_val)) == 0) {
+    // the peer is reset, so the send fails with ECONNRESET or EPIPE.
+    struct linger reset {};
+    reset.l_onoff = 1;
+    ASSERT_EQ(::setsockopt(recv_fd, SOL_SOCKET, SO_LINGER, &reset,
+                           sizeof(reset)),
+              0);
+    ::close(recv_fd);
+    recv_fd = -1;
+    ::usleep(10 * 1000);
+    auto* old_handler = ::signal(SIGPIPE, SIG_IGN);
+
+    std::string sent(0x10000, 'x');
+    Buffer test_buffer{};
+    test_buffer.SetZeroCopy(0x1000);
+    ASSERT_TRUE(test_buffer.Add(sent.data(), sent.size()));
+    errno = 0;
+    EXPECT_EQ(test_buffer.Write(send_fd), -1);
+    EXPECT_TRUE(errno == ECONNRESET || errno == EPIPE);
+    EXPECT_EQ(test_buffer.Size(), sent.size());
+    ::signal(SIGPIPE, old_handler);
+  }
+
+  ::close(send_fd);
+  if (recv_fd >= 0) {
+    ::close(recv_fd);
+  }
+  ::close(listen_fd);
+}
+#endif
+#endif
+
 auto main(int argc, char** argv) -> int {
   ::testing::InitGoogleTest(&argc, argv);
 
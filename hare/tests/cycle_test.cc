@@ -0,0 +1,44 @@
+#include <gtest/gtest.h>
+#include <hare/base/io/cycle.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+TEST(CycleTest, testTimer) {
+  std::atomic<hare::io::Cycle*> running{nullptr};
+  std::thread cycle_thread([&] {
+    hare::io::Cycle cycle(hare::io::Cycle::REACTOR_TYPE_EPOLL);
+    cycle.QueueInCycle([&] { running = &cycle; });
+    cycle.Exec();
+  });
+  while (running == nullptr) {
+    std::this_thread::yield();
+  }
+  auto* cycle = running.load();
+
+  // the earliest timer fires first, whatever the order of adding.
+  std::vector<std::int32_t> fired{};
+  std::int32_t every{0};
+  cycle->RunAfter([&] { fired.push_back(3); }, 30 * 1000);
+  cycle->RunAfter([&] { fired.push_back(1); }, 10 * 1000);
+  cycle->RunAfter([&] { fired.push_back(2); }, 20 * 1000);
+  auto id = cycle->RunEvery([&] { ++every; }, 5 * 1000);
+  cycle->RunAfter(
+      [&] {
+        cycle->Cancel(id);
+        cycle->Exit();
+      },
+      60 * 1000);
+  cycle_thread.join();
+
+  EXPECT_EQ(fired, (std::vector<std::int32_t>{1, 2, 3}));
+  // the persistent timer is kept until cancelled.
+  EXPECT_GE(every, 3);
+}
+
+auto main(int argc, char** argv) -> int {
+  ::testing::InitGoogleTest(&argc, argv);
+
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,1426 @@
+#include <gtest/gtest.h>
+#include <hare/base/io/cycle.h>
+#include <hare/base/io/file.h>
+#include <hare/base/time/timestamp.h>
+#include <hare/net/tcp/acceptor.h>
+#include <hare/net/tcp/serve.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(H_OS_UNIX)
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+#define FMT_HEADER_ONLY 1
+#include <fmt/format.h>
+
+namespace {
+
+constexpr std::int32_t kWorkers = 4;
+constexpr std::int32_t kClients = 4;
+constexpr std::int32_t kConnectsPerClient = 500;
+
+auto LoopbackAddress(std::uint16_t _port) -> struct sockaddr_in {
+  struct sockaddr_in addr {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(_port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  return addr;
+}
+
+auto ConnectTo(std::uint16_t _port) -> bool {
+  auto addr = LoopbackAddress(_port);
+  for (auto i = 0; i < 100; ++i) {
+    auto fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (::connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0) {
+      ::close(fd);
+      return true;
+    }
+    ::close(fd);
+    ::usleep(10 * 1000);
+  }
+  return false;
+}
+
+/**
+ * @brief Runs a serve listening on the loopback `_port` in its own thread,
+ *   `_setup` is applied before executing. `Listening()` is false if the
+ *   port cannot be bound, then the thread has returned already.
+ **/
+class ServeRunner : public hare::util::NonCopyable {
+ public:
+  using SessionCallback =
+      std::function<void(const hare::Ptr<hare::net::TcpSession>&)>;
+  using Setup = std::function<void(hare::net::TcpServe&)>;
+
+ private:
+  std::uint16_t port_{0};
+  std::atomic<std::int32_t> listening_{0};
+  std::atomic<hare::net::TcpServe*> serve_{nullptr};
+  std::atomic<hare::io::Cycle*> cycle_{nullptr};
+  std::thread thread_{};
+
+ public:
+  ServeRunner(std::uint16_t _port, const std::string& _name,
+              const SessionCallback& _new_session, const Setup& _setup = {})
+      : port_(_port) {
+    thread_ = std::thread([=] {
+      hare::io::Cycle cycle(hare::io::Cycle::REACTOR_TYPE_EPOLL);
+      hare::net::TcpServe serve(&cycle, _name);
+      if (_setup) {
+        _setup(serve);
+      }
+      serve.SetNewSession([=](const hare::Ptr<hare::net::TcpSession>& _session,
+                              const hare::Timestamp&,
+                              const hare::Ptr<hare::net::Acceptor>&) {
+        _new_session(_session);
+      });
+      if (!serve.AddAcceptor(
+              std::make_shared<hare::net::Acceptor>(AF_INET, port_))) {
+        listening_ = -1;
+        return;
+      }
+      serve_ = &serve;
+      cycle_ = &cycle;
+      listening_ = 1;
+      serve.Exec(kWorkers);
+    });
+    while (listening_ == 0) {
+      std::this_thread::yield();
+    }
+    if (listening_ < 0) {
+      thread_.join();
+      ADD_FAILURE() << "cannot listen on port " << port_;
+    }
+  }
+
+  ~ServeRunner() { Stop(); }
+
+  auto Listening() const -> bool { return listening_ > 0; }
+  auto serve() const -> hare::net::TcpServe* { return serve_; }
+  auto cycle() const -> hare::io::Cycle* { return cycle_; }
+
+  // a blocking socket connected to the serve, -1 on failure.
+  auto Connect() const -> hare::util_socket_t {
+    auto addr = LoopbackAddress(port_);
+    auto fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (fd >= 0 &&
+        ::connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+      ::close(fd);
+      fd = -1;
+    }
+    return fd;
+  }
+
+  // `_in_cycle` runs in the main cycle right before it exits.
+  void Stop(const std::function<void()>& _in_cycle = {}) {
+    if (!thread_.joinable()) {
+      return;
+    }
+    auto* cycle = cycle_.load();
+    cycle->RunInCycle([&] {
+      if (_in_cycle) {
+        _in_cycle();
+      }
+      cycle->Exit();
+    });
+    thread_.join();
+  }
+};
+
+// returns the accepted sessions per second.
+auto AcceptRate(hare::net::AcceptMode _mode, std::uint16_t _port,
+                hare::net::PlacementPolicy _policy =
+                    hare::net::PLACEMENT_ROUND_ROBIN,
+                std::uint64_t* _hits = nullptr) -> double {
+  using hare::net::TcpServe;
+  using hare::net::TcpSession;
+
+  constexpr auto total = kClients * kConnectsPerClient;
+  std::atomic<std::int32_t> accepted{0};
+
+  auto on_session = [&](const hare::Ptr<TcpSession>& _session) {
+    _session->SetConnectCallback(
+        [](const hare::Ptr<TcpSession>&, std::uint8_t) {});
+    _session->SetReadCallback([](const hare::Ptr<TcpSession>&,
+                                 hare::net::Buffer& _buffer,
+                                 const hare::Timestamp&) {
+      _buffer.ClearAll();
+    });
+    ++accepted;
+  };
+  auto setup = [&](TcpServe& _serve) {
+    _serve.SetAcceptMode(_mode);
+    _serve.SetPlacementPolicy(_policy);
+  };
+  ServeRunner runner(_port, "ACCEPT_BENCH", on_session, setup);
+  if (!runner.Listening()) {
+    return 0;
+  }
+
+  auto start{hare::Timestamp::Now()};
+  std::vector<std::thread> clients{};
+  std::atomic<std::int32_t> connected{0};
+  for (auto i = 0; i < kClients; ++i) {
+    clients.emplace_back([&] {
+      for (auto j = 0; j < kConnectsPerClient; ++j) {
+        if (ConnectTo(_port)) {
+          ++connected;
+        }
+      }
+    });
+  }
+  for (auto& client : clients) {
+    client.join();
+  }
+  for (auto i = 0; i < 1000 && accepted < total; ++i) {
+    ::usleep(1000);
+  }
+  auto end{hare::Timestamp::Now()};
+  auto gap = hare::Timestamp::Difference(end, start);
+
+  if (_hits != nullptr) {
+    *_hits = runner.serve()->LocalityHits();
+  }
+  runner.Stop();
+
+  EXPECT_EQ(connected, total);
+  EXPECT_EQ(accepted, total);
+  return gap > 0 ? accepted / gap : 0;
+}
+
+}  // namespace
+
+TEST(TcpServeTest, bench) {
+  auto main_rate = AcceptRate(hare::net::ACCEPT_MAIN, 19701);
+  auto reuse_rate = AcceptRate(hare::net::ACCEPT_REUSE_PORT, 19702);
+  std::uint64_t hits{0};
+  auto cpu_rate = AcceptRate(hare::net::ACCEPT_MAIN, 19704,
+                             hare::net::PLACEMENT_INCOMING_CPU, &hits);
+  fmt::print(
+      "accept rate: main={:.0f}/s, reuse-port={:.0f}/s, "
+      "incoming-cpu={:.0f}/s ({} locality hits)" HARE_EOL,
+      main_rate, reuse_rate, cpu_rate, hits);
+  ASSERT_GT(main_rate, 0);
+  ASSERT_GT(reuse_rate, 0);
+  ASSERT_GT(cpu_rate, 0);
+  ASSERT_LE(hits, kClients * kConnectsPerClient);
+}
+
+TEST(TcpServeTest, testPlacement) {
+  using hare::net::TcpServe;
+  using hare::net::TcpSession;
+
+  constexpr std::uint16_t port = 19703;
+  std::mutex mutex{};
+  std::map<std::uint16_t, hare::io::Cycle*> placed{};
+  std::atomic<std::int32_t> closed{0};
+
+  auto on_session = [&](const hare::Ptr<TcpSession>& _session) {
+    _session->SetConnectCallback(
+        [&](const hare::Ptr<TcpSession>&, std::uint8_t _event) {
+          if ((_event & hare::net::SESSION_CLOSED) != 0) {
+            ++closed;
+          }
+        });
+    _session->SetReadCallback([](const hare::Ptr<TcpSession>&,
+                                 hare::net::Buffer& _buffer,
+                                 const hare::Timestamp&) {
+      _buffer.ClearAll();
+    });
+    std::lock_guard<std::mutex> lock(mutex);
+    placed[_session->PeerAddress().Port()] = _session->OwnerCycle();
+  };
+  auto setup = [&](TcpServe& _serve) {
+    _serve.SetPlacementPolicy(hare::net::PLACEMENT_LEAST_CONNECTIONS);
+  };
+  ServeRunner runner(port, "PLACEMENT_TEST", on_session, setup);
+  ASSERT_TRUE(runner.Listening());
+
+  using Connection = std::pair<hare::util_socket_t, hare::io::Cycle*>;
+  auto connect_one = [&]() -> Connection {
+    struct sockaddr_in addr {};
+    socklen_t addr_len = sizeof(addr);
+    auto fd = runner.Connect();
+    EXPECT_GE(fd, 0);
+    EXPECT_EQ(::getsockname(fd, (struct sockaddr*)&addr, &addr_len), 0);
+    for (auto i = 0; i < 1000; ++i) {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto iter = placed.find(ntohs(addr.sin_port));
+        if (iter != placed.end()) {
+          return std::make_pair(fd, iter->second);
+        }
+      }
+      ::usleep(1000);
+    }
+    return std::make_pair(fd, nullptr);
+  };
+
+  std::vector<Connection> conns{};
+  for (auto i = 0; i < kWorkers * 2; ++i) {
+    conns.push_back(connect_one());
+    ASSERT_NE(conns.back().second, nullptr);
+  }
+
+  // empties the worker of the first session, new sessions go there.
+  auto* emptied = conns.front().second;
+  auto closing{0};
+  for (auto& conn : conns) {
+    if (conn.second == emptied) {
+      ::close(conn.first);
+      conn.first = -1;
+      ++closing;
+    }
+  }
+  ASSERT_EQ(closing, 2);
+  for (auto i = 0; i < 1000 && closed < closing; ++i) {
+    ::usleep(1000);
+  }
+  ASSERT_EQ(closed, closing);
+  // the counters drop right after the close callbacks.
+  ::usleep(10 * 1000);
+  for (auto i = 0; i < closing; ++i) {
+    conns.push_back(connect_one());
+    EXPECT_EQ(conns.back().second, emptied);
+  }
+
+  for (auto& conn : conns) {
+    if (conn.first != -1) {
+      ::close(conn.first);
+    }
+  }
+  runner.Stop();
+}
+
+TEST(TcpServeTest, testMigrate) {
+  using hare::net::TcpSession;
+
+  constexpr std::uint16_t port = 19705;
+  std::mutex mutex{};
+  hare::Ptr<TcpSession> accepted{};
+
+  auto on_session = [&](const hare::Ptr<TcpSession>& _session) {
+    _session->SetConnectCallback(
+        [](const hare::Ptr<TcpSession>&, std::uint8_t) {});
+    _session->SetReadCallback([](const hare::Ptr<TcpSession>& _tcp,
+                                 hare::net::Buffer& _buffer,
+                                 const hare::Timestamp&) {
+      _tcp->Append(_buffer);
+    });
+    std::lock_guard<std::mutex> lock(mutex);
+    accepted = _session;
+  };
+  ServeRunner runner(port, "MIGRATE_TEST", on_session);
+  ASSERT_TRUE(runner.Listening());
+
+  auto fd = runner.Connect();
+  ASSERT_GE(fd, 0);
+  auto echo = [&](char _byte) {
+    char got{0};
+    EXPECT_EQ(::write(fd, &_byte, 1), 1);
+    EXPECT_EQ(::read(fd, &got, 1), 1);
+    EXPECT_EQ(got, _byte);
+  };
+  echo('a');
+
+  hare::Ptr<TcpSession> session{};
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    session = accepted;
+  }
+  ASSERT_TRUE(session);
+  // resolved lazily.
+  EXPECT_EQ(session->LocalAddress().Port(), port);
+  EXPECT_EQ(session->Name(), "MIGRATE_TEST-127.0.0.1:19705#tcp0");
+  auto* previous = session->OwnerCycle();
+  ASSERT_TRUE(runner.serve()->Migrate(session, kWorkers - 1));
+  for (auto i = 0; i < 1000 && runner.serve()->Migrations() == 0; ++i) {
+    ::usleep(1000);
+  }
+  ASSERT_EQ(runner.serve()->Migrations(), 1);
+  EXPECT_NE(session->OwnerCycle(), previous);
+  echo('b');
+
+  // moving it back.
+  ASSERT_TRUE(runner.serve()->Migrate(session, 0));
+  for (auto i = 0; i < 1000 && runner.serve()->Migrations() < 2; ++i) {
+    ::usleep(1000);
+  }
+  EXPECT_EQ(session->OwnerCycle(), previous);
+  echo('c');
+
+  ::close(fd);
+  session.reset();
+  runner.Stop();
+  accepted.reset();
+}
+
+TEST(TcpServeTest, testIdleFootprint) {
+  using hare::net::TcpServe;
+  using hare::net::TcpSession;
+
+  constexpr std::uint16_t port = 19706;
+  constexpr auto total = 400;
+  std::atomic<std::int32_t> received{0};
+
+  auto callbacks = std::make_shared<TcpSession::Callbacks>();
+  callbacks->connect = [](const hare::Ptr<TcpSession>&, std::uint8_t) {};
+  callbacks->read = [&](const hare::Ptr<TcpSession>&,
+                        hare::net::Buffer& _buffer, const hare::Timestamp&) {
+    _buffer.ClearAll();
+    ++received;
+  };
+
+  auto on_session = [&](const hare::Ptr<TcpSession>& _session) {
+    _session->SetCallbacks(callbacks);
+  };
+  auto setup = [&](TcpServe& _serve) {
+    _serve.SetIdleRelease(50 * 1000);
+  };
+  ServeRunner runner(port, "FOOTPRINT_TEST", on_session, setup);
+  ASSERT_TRUE(runner.Listening());
+
+  // the heap in use, freed blocks kept by the allocator are not counted.
+  auto in_use = []() -> std::int64_t {
+#if defined(__GLIBC__) && \
+    (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    return static_cast<std::int64_t>(::mallinfo2().uordblks);
+#else
+    return -1;
+#endif
+  };
+
+  std::vector<hare::util_socket_t> fds{};
+  fds.reserve(total);
+  // the freed blocks are not kept by the pools of workers.
+  hare::net::Buffer::SetBlockPool(0);
+  auto before = in_use();
+  for (auto i = 0; i < total; ++i) {
+    auto fd = runner.Connect();
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(::write(fd, "x", 1), 1);
+    fds.push_back(fd);
+  }
+  for (auto i = 0; i < 1000 && received < total; ++i) {
+    ::usleep(1000);
+  }
+  ASSERT_EQ(received, total);
+  // the blocks are freed by the wheel once the sessions are idle.
+  for (auto i = 0; i < 1000 && runner.serve()->BufferUsage() != 0; ++i) {
+    ::usleep(1000);
+  }
+  EXPECT_EQ(runner.serve()->BufferUsage(), 0);
+  auto after = in_use();
+  if (before >= 0) {
+    auto per_session = (after - before) / total;
+    fmt::print("idle footprint: {} bytes per connection" HARE_EOL,
+               per_session);
+    // the session, its event and the entry of the worker.
+    EXPECT_LT(per_session, 2048);
+  }
+  hare::net::Buffer::SetBlockPool(1024 * 1024);
+
+  for (auto fd : fds) {
+    ::close(fd);
+  }
+  runner.Stop();
+}
+
+TEST(TcpServeTest, testSharedRead) {
+  using hare::net::TcpSession;
+
+  constexpr std::uint16_t port = 19707;
+
+  auto on_session = [&](const hare::Ptr<TcpSession>& _session) {
+    _session->SetSharedRead(true);
+    // the output frees its blocks once written as well.
+    _session->SetBufferTrim(0, 1);
+    _session->SetConnectCallback(
+        [](const hare::Ptr<TcpSession>&, std::uint8_t) {});
+    _session->SetReadCallback([](const hare::Ptr<TcpSession>& _tcp,
+                                 hare::net::Buffer& _buffer,
+                                 const hare::Timestamp&) {
+      hare::net::Buffer frame{};
+      while (_buffer.ReadFrame(frame) > 0) {
+        _tcp->Append(frame);
+      }
+    });
+  };
+  ServeRunner runner(port, "SHARED_READ_TEST", on_session);
+  ASSERT_TRUE(runner.Listening());
+
+  auto fd = runner.Connect();
+  ASSERT_GE(fd, 0);
+
+  const char frame[] = "\x00\x00\x00\x05hello";
+  std::array<char, 5> got{};
+  auto global = hare::net::BufferBudget::Global()->Usage();
+  ASSERT_EQ(::write(fd, frame, 9), 9);
+  ASSERT_EQ(::read(fd, got.data(), got.size()), 5);
+  EXPECT_EQ(std::string(got.data(), got.size()), "hello");
+  EXPECT_EQ(runner.serve()->BufferUsage(), 0);
+  // the scratch of the cycle is not charged to the global budget.
+  EXPECT_EQ(hare::net::BufferBudget::Global()->Usage(), global);
+
+  // only the partial frame is kept by the session.
+  ASSERT_EQ(::write(fd, frame, 6), 6);
+  for (auto i = 0; i < 1000 && runner.serve()->BufferUsage() == 0; ++i) {
+    ::usleep(1000);
+  }
+  EXPECT_GT(runner.serve()->BufferUsage(), 0);
+  ASSERT_EQ(::write(fd, frame + 6, 3), 3);
+  ASSERT_EQ(::read(fd, got.data(), got.size()), 5);
+  EXPECT_EQ(std::string(got.data(), got.size()), "hello");
+  for (auto i = 0; i < 1000 && runner.serve()->BufferUsage() != 0; ++i) {
+    ::usleep(1000);
+  }
+  EXPECT_EQ(runner.serve()->BufferUsage(), 0);
+
+  ::close(fd);
+  runner.Stop();
+}
+
+TEST(TcpServeTest, testSendComplete) {
+  using hare::net::TcpSession;
+
+  constexpr std::uint16_t port = 19708;
+  constexpr std::size_t large = 32 * 1024 * 1024;
+  std::mutex mutex{};
+  std::vector<std::int32_t> order{};
+
+  auto on_session = [&](const hare::Ptr<TcpSession>& _session) {
+    _session->SetConnectCallback(
+        [](const hare::Ptr<TcpSession>&, std::uint8_t) {});
+    _session->SetWriteCallback([](const hare::Ptr<TcpSession>&) {});
+    _session->SetReadCallback([&](const hare::Ptr<TcpSession>& _tcp,
+                                  hare::net::Buffer& _buffer,
+                                  const hare::Timestamp&) {
+      _buffer.ClearAll();
+      auto done = [&](std::int32_t _id) {
+        return [&, _id](const hare::Ptr<TcpSession>&, bool _written) {
+          std::lock_guard<std::mutex> lock(mutex);
+          order.push_back(_written ? _id : -_id);
+        };
+      };
+      std::string data(large, 'x');
+      _tcp->Send(data.data(), data.size(), done(1));
+      _tcp->Send("y", 1, done(2));
+      hare::net::Buffer tail{};
+      tail.Add("z", 1);
+      _tcp->Append(tail, done(3));
+    });
+  };
+  ServeRunner runner(port, "SEND_COMPLETE_TEST", on_session);
+  ASSERT_TRUE(runner.Listening());
+
+  auto fd = runner.Connect();
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(::write(fd, "a", 1), 1);
+
+  // the first token waits for the large message to be drained.
+  ::usleep(20 * 1000);
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    EXPECT_TRUE(order.empty());
+  }
+  std::vector<char> received(large + 2);
+  std::size_t total{0};
+  while (total < received.size()) {
+    auto read_n = ::read(fd, received.data() + total, received.size() - total);
+    ASSERT_GT(read_n, 0);
+    total += static_cast<std::size_t>(read_n);
+  }
+  EXPECT_EQ(received[large], 'y');
+  EXPECT_EQ(received[large + 1], 'z');
+  for (auto i = 0; i < 1000; ++i) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (order.size() == 3) {
+        break;
+      }
+    }
+    ::usleep(1000);
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    EXPECT_EQ(order, std::vector<std::int32_t>({1, 2, 3}));
+  }
+
+  ::close(fd);
+  runner.Stop();
+}
+
+TEST(TcpServeTest, testOutputQueues) {
+  using hare::net::TcpSession;
+
+  constexpr std::uint16_t port = 19709;
+  constexpr std::size_t message = 1024 * 1024;
+  constexpr std::size_t count = 32;
+
+  auto on_session = [&](const hare::Ptr<TcpSession>& _session) {
+    _session->SetConnectCallback(
+        [](const hare::Ptr<TcpSession>& _tcp, std::uint8_t _events) {
+          if ((_events & hare::net::SESSION_CONNECTED) != 0) {
+            _tcp->SetOutputQueues(2);
+          }
+        });
+    _session->SetWriteCallback([](const hare::Ptr<TcpSession>&) {});
+    _session->SetReadCallback([](const hare::Ptr<TcpSession>& _tcp,
+                                 hare::net::Buffer& _buffer,
+                                 const hare::Timestamp&) {
+      _buffer.ClearAll();
+      std::string bulk(message, 'x');
+      for (std::size_t i = 0; i < count; ++i) {
+        _tcp->Send(bulk.data(), bulk.size());
+      }
+      // jumps ahead of the bulk messages not taken yet.
+      _tcp->SendTo(0, "!", 1);
+    });
+  };
+  ServeRunner runner(port, "OUTPUT_QUEUES_TEST", on_session);
+  ASSERT_TRUE(runner.Listening());
+
+  auto fd = runner.Connect();
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(::write(fd, "a", 1), 1);
+
+  std::vector<char> received(message * count + 1);
+  std::size_t total{0};
+  while (total < received.size()) {
+    auto read_n = ::read(fd, received.data() + total, received.size() - total);
+    ASSERT_GT(read_n, 0);
+    total += static_cast<std::size_t>(read_n);
+  }
+  auto urgent = std::find(received.begin(), received.end(), '!');
+  ASSERT_NE(urgent, received.end());
+  EXPECT_LT(static_cast<std::size_t>(urgent - received.begin()),
+            message * count / 2);
+
+  ::close(fd);
+  runner.Stop();
+}
+
+TEST(TcpServeTest, testNotSentLowat) {
+  using hare::net::TcpSession;
+
+  constexpr std::uint16_t port = 19710;
+  constexpr std::uint32_t lowat = 16 * 1024;
+  constexpr std::size_t total = 16 * 1024 * 1024;
+  std::atomic<bool> sampled{false};
+  hare::net::SessionStats stats{};
+
+  auto on_session = [&](const hare::Ptr<TcpSession>& _session) {
+    _session->SetConnectCallback(
+        [](const hare::Ptr<TcpSession>& _tcp, std::uint8_t _events) {
+          if ((_events & hare::net::SESSION_CONNECTED) != 0) {
+            // 0 is passed to the kernel, which falls back to the sysctl.
+            EXPECT_TRUE(_tcp->SetNotSentLowat(0));
+            std::uint32_t value{1};
+            socklen_t len = sizeof(value);
+            EXPECT_EQ(::getsockopt(_tcp->Fd(), IPPROTO_TCP,
+                                   TCP_NOTSENT_LOWAT, &value, &len),
+                      0);
+            EXPECT_EQ(value, 0);
+            EXPECT_TRUE(_tcp->SetNotSentLowat(lowat));
+          }
+        });
+    _session->SetWriteCallback([](const hare::Ptr<TcpSession>&) {});
+    _session->SetReadCallback([&](const hare::Ptr<TcpSession>& _tcp,
+                                  hare::net::Buffer& _buffer,
+                                  const hare::Timestamp&) {
+      _buffer.ClearAll();
+      std::string bulk(total, 'x');
+      _tcp->Send(bulk.data(), bulk.size());
+      // takes a sample at once.
+      _tcp->SetStatsInterval(1000 * 1000);
+      stats = _tcp->Stats();
+      sampled = true;
+    });
+  };
+  ServeRunner runner(port, "NOTSENT_LOWAT_TEST", on_session);
+  ASSERT_TRUE(runner.Listening());
+
+  auto fd = runner.Connect();
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(::write(fd, "a", 1), 1);
+  for (auto i = 0; i < 1000 && !sampled; ++i) {
+    ::usleep(1000);
+  }
+  ASSERT_TRUE(sampled);
+  // the rest is held by the session instead of the kernel.
+  EXPECT_GT(stats.pending_output, 0);
+  EXPECT_GE(stats.kernel_queued, stats.kernel_unsent);
+  EXPECT_LT(stats.kernel_unsent, 256 * 1024);
+
+  std::vector<char> received(64 * 1024);
+  std::size_t read_total{0};
+  while (read_total < total) {
+    auto read_n = ::read(fd, received.data(), received.size());
+    ASSERT_GT(read_n, 0);
+    read_total += static_cast<std::size_t>(read_n);
+  }
+  EXPECT_EQ(read_total, total);
+
+  ::close(fd);
+  runner.Stop();
+}
+
+TEST(TcpServeTest, testRecvTimestamp) {
+  using hare::net::TcpSession;
+
+  constexpr std::uint16_t port = 19711;
+  std::atomic<bool> enabled{false};
+  std::atomic<bool> received{false};
+  hare::Timestamp kernel_time{};
+  hare::Timestamp dispatch_time{};
+
+  auto on_session = [&](const hare::Ptr<TcpSession>& _session) {
+    _session->SetConnectCallback(
+        [&](const hare::Ptr<TcpSession>& _tcp, std::uint8_t _events) {
+          if ((_events & hare::net::SESSION_CONNECTED) != 0) {
+            EXPECT_TRUE(_tcp->SetRecvTimestamp(true));
+            enabled = true;
+          }
+        });
+    _session->SetReadCallback([&](const hare::Ptr<TcpSession>& _tcp,
+                                  hare::net::Buffer& _buffer,
+                                  const hare::Timestamp& _time) {
+      _buffer.ClearAll();
+      kernel_time = _tcp->ReceiveTime();
+      dispatch_time = _time;
+      received = true;
+    });
+  };
+  ServeRunner runner(port, "RECV_TIMESTAMP_TEST", on_session);
+  ASSERT_TRUE(runner.Listening());
+
+  auto fd = runner.Connect();
+  ASSERT_GE(fd, 0);
+  for (auto i = 0; i < 1000 && !enabled; ++i) {
+    ::usleep(1000);
+  }
+  ASSERT_TRUE(enabled);
+  ASSERT_EQ(::write(fd, "a", 1), 1);
+  for (auto i = 0; i < 1000 && !received; ++i) {
+    ::usleep(1000);
+  }
+  ASSERT_TRUE(received);
+  ASSERT_TRUE(kernel_time.Valid());
+  // the packet arrives before the cycle dispatches it.
+  EXPECT_LE(kernel_time.microseconds_since_epoch(),
+            dispatch_time.microseconds_since_epoch());
+  EXPECT_LT(hare::Timestamp::Difference(dispatch_time, kernel_time), 1.0);
+
+  ::close(fd);
+  runner.Stop();
+}
+
+TEST(TcpServeTest, testSessionStats) {
+  using hare::net::TcpSession;
+
+  constexpr std::uint16_t port = 19712;
+  constexpr std::size_t total = 4 * 1024 * 1024;
+  std::atomic<bool> sampled{false};
+  hare::net::SessionStats stats{};
+
+  auto on_session = [&](const hare::Ptr<TcpSession>& _session) {
+    _session->SetConnectCallback(
+        [](const hare::Ptr<TcpSession>& _tcp, std::uint8_t _events) {
+          if ((_events & hare::net::SESSION_CONNECTED) != 0) {
+            _tcp->SetStatsInterval(1000);
+          }
+        });
+    _session->SetWriteCallback([](const hare::Ptr<TcpSession>&) {});
+    _session->SetReadCallback([&](const hare::Ptr<TcpSession>& _tcp,
+                                  hare::net::Buffer& _buffer,
+                                  const hare::Timestamp&) {
+      _buffer.ClearAll();
+      if (_tcp->Stats().bytes_in == 1) {
+        std::string bulk(total, 'x');
+        _tcp->Send(bulk.data(), bulk.size());
+      } else {
+        stats = _tcp->Stats();
+        sampled = true;
+      }
+    });
+  };
+  ServeRunner runner(port, "SESSION_STATS_TEST", on_session);
+  ASSERT_TRUE(runner.Listening());
+
+  auto fd = runner.Connect();
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(::write(fd, "a", 1), 1);
+
+  std::vector<char> received(64 * 1024);
+  std::size_t read_total{0};
+  while (read_total < total) {
+    auto read_n = ::read(fd, received.data(), received.size());
+    ASSERT_GT(read_n, 0);
+    read_total += static_cast<std::size_t>(read_n);
+  }
+  // lets the cycle sample again after the transfer.
+  ::usleep(10 * 1000);
+  ASSERT_EQ(::write(fd, "b", 1), 1);
+  for (auto i = 0; i < 1000 && !sampled; ++i) {
+    ::usleep(1000);
+  }
+  ASSERT_TRUE(sampled);
+
+  EXPECT_EQ(stats.bytes_in, 2);
+  EXPECT_EQ(stats.reads, 2);
+  EXPECT_EQ(stats.bytes_out, total);
+  EXPECT_GE(stats.writes, 1);
+  EXPECT_GT(stats.output_peak, 0);
+  EXPECT_LE(stats.output_peak, total);
+  EXPECT_EQ(stats.pending_output, 0);
+  ASSERT_TRUE(stats.info_time.Valid());
+  EXPECT_GT(stats.tcp_info.snd_cwnd, 0);
+  EXPECT_GE(stats.kernel_queued, 0);
+
+  ::close(fd);
+  runner.Stop();
+}
+
+TEST(TcpServeTest, testStatsWithoutReader) {
+  using hare::net::TcpSession;
+
+  constexpr std::uint16_t port = 19720;
+  std::atomic<bool> failed{false};
+  hare::net::SessionStats stats{};
+
+  auto on_session = [&](const hare::Ptr<TcpSession>& _session) {
+    // no read callback, the data read is reported as an error.
+    _session->SetWriteCallback([](const hare::Ptr<TcpSession>&) {});
+    _session->SetConnectCallback(
+        [&](const hare::Ptr<TcpSession>& _tcp, std::uint8_t _events) {
+          if ((_events & hare::net::SESSION_ERROR) != 0) {
+            stats = _tcp->Stats();
+            failed = true;
+            _tcp->ForceClose();
+          }
+        });
+  };
+  ServeRunner runner(port, "STATS_WITHOUT_READER_TEST", on_session);
+  ASSERT_TRUE(runner.Listening());
+
+  auto fd = runner.Connect();
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(::write(fd, "abc", 3), 3);
+  for (auto i = 0; i < 1000 && !failed; ++i) {
+    ::usleep(1000);
+  }
+  ASSERT_TRUE(failed);
+  // counted where it is received, not where it is delivered.
+  EXPECT_EQ(stats.bytes_in, 3);
+  EXPECT_EQ(stats.reads, 1);
+  // never sampled.
+  EXPECT_EQ(stats.kernel_queued, -1);
+  EXPECT_FALSE(stats.info_time.Valid());
+
+  ::close(fd);
+  runner.Stop();
+}
+
+TEST(TcpServeTest, testBudgetResume) {
+  using hare::net::TcpServe;
+  using hare::net::TcpSession;
+
+  constexpr std::uint16_t port = 19713;
+  constexpr std::size_t limit = 256 * 1024;
+  constexpr std::size_t total = 8 * 1024 * 1024;
+  std::atomic<std::size_t> received{0};
+  std::atomic<bool> released{false};
+  std::atomic<hare::io::Cycle*> session_cycle{nullptr};
+  hare::net::Buffer held{};
+
+  auto on_session = [&](const hare::Ptr<TcpSession>& _session) {
+    _session->SetConnectCallback(
+        [](const hare::Ptr<TcpSession>&, std::uint8_t) {});
+    _session->SetReadCallback([&](const hare::Ptr<TcpSession>& _tcp,
+                                  hare::net::Buffer& _buffer,
+                                  const hare::Timestamp&) {
+      session_cycle = _tcp->OwnerCycle();
+      received += _buffer.Size();
+      // the blocks are still charged after moved out of the session.
+      if (released) {
+        _buffer.ClearAll();
+      } else {
+        held.Append(_buffer);
+      }
+    });
+  };
+  auto setup = [&](TcpServe& _serve) {
+    _serve.SetBufferBudget(limit);
+  };
+  ServeRunner runner(port, "BUDGET_TEST", on_session, setup);
+  ASSERT_TRUE(runner.Listening());
+
+  auto fd = runner.Connect();
+  ASSERT_GE(fd, 0);
+  std::thread writer([&] {
+    std::string bulk(total, 'x');
+    std::size_t written{0};
+    while (written < total) {
+      auto write_n = ::write(fd, bulk.data() + written, total - written);
+      if (write_n <= 0) {
+        break;
+      }
+      written += static_cast<std::size_t>(write_n);
+    }
+  });
+
+  for (auto i = 0; i < 1000 && received < limit; ++i) {
+    ::usleep(1000);
+  }
+  ASSERT_GE(received, limit);
+  // the session is paused until the held blocks are freed.
+  ::usleep(50 * 1000);
+  auto paused = received.load();
+  ::usleep(50 * 1000);
+  EXPECT_EQ(received, paused);
+  EXPECT_LT(paused, total);
+
+  session_cycle.load()->RunInCycle([&] {
+    held.ClearAll();
+    released = true;
+  });
+  for (auto i = 0; i < 5000 && received < total; ++i) {
+    ::usleep(1000);
+  }
+  EXPECT_EQ(received, total);
+
+  writer.join();
+  ::close(fd);
+  runner.Stop();
+}
+
+TEST(TcpServeTest, testDirectWrite) {
+  using hare::net::BufferSpan;
+  using hare::net::TcpSession;
+
+  constexpr std::uint16_t port = 19714;
+  constexpr std::size_t chunk = 1000;
+  constexpr std::size_t spans = 100;
+  constexpr std::size_t span_size = 256 * 1024;
+  std::atomic<std::size_t> chunked{0};
+  std::atomic<bool> spanned{false};
+  hare::net::SessionStats chunk_stats{};
+  hare::net::SessionStats span_stats{};
+
+  auto on_session = [&](const hare::Ptr<TcpSession>& _session) {
+    _session->SetConnectCallback(
+        [](const hare::Ptr<TcpSession>&, std::uint8_t) {});
+    _session->SetWriteCallback([](const hare::Ptr<TcpSession>&) {});
+    _session->SetReadCallback([&](const hare::Ptr<TcpSession>& _tcp,
+                                  hare::net::Buffer& _buffer,
+                                  const hare::Timestamp&) {
+      std::string command(_buffer.Size(), '\0');
+      _buffer.Remove(&command[0], command.size());
+      if (command.find('a') != std::string::npos) {
+        // written directly until the kernel takes a part or nothing.
+        std::size_t sent{0};
+        while (_tcp->Stats().pending_output == 0) {
+          std::string data(chunk, static_cast<char>('a' + sent % 26));
+          _tcp->Send(data.data(), data.size());
+          ++sent;
+        }
+        chunk_stats = _tcp->Stats();
+        chunked = sent * chunk;
+      }
+      if (command.find('b') != std::string::npos) {
+        std::vector<std::string> parts{};
+        std::vector<BufferSpan> views{};
+        for (std::size_t i = 0; i < spans; ++i) {
+          parts.emplace_back(span_size, static_cast<char>('A' + i % 26));
+        }
+        for (const auto& part : parts) {
+          views.push_back(BufferSpan{part.data(), part.size()});
+        }
+        auto before = _tcp->Stats();
+        EXPECT_TRUE(_tcp->SendV(views.data(), views.size()));
+        span_stats = _tcp->Stats();
+        span_stats.bytes_out -= before.bytes_out;
+        span_stats.writes -= before.writes;
+        spanned = true;
+      }
+    });
+  };
+  ServeRunner runner(port, "DIRECT_WRITE_TEST", on_session);
+  ASSERT_TRUE(runner.Listening());
+
+  auto fd = runner.Connect();
+  ASSERT_GE(fd, 0);
+  auto read_all = [fd](std::size_t _size) {
+    std::string received(_size, '\0');
+    std::size_t total{0};
+    while (total < _size) {
+      auto read_n = ::read(fd, &received[total], _size - total);
+      if (read_n <= 0) {
+        break;
+      }
+      total += static_cast<std::size_t>(read_n);
+    }
+    received.resize(total);
+    return received;
+  };
+
+  ASSERT_EQ(::write(fd, "a", 1), 1);
+  for (auto i = 0; i < 5000 && chunked == 0; ++i) {
+    ::usleep(1000);
+  }
+  ASSERT_GT(chunked, chunk);
+  // the rest of the last chunk is left to the buffer.
+  EXPECT_GT(chunk_stats.pending_output, 0);
+  EXPECT_LE(chunk_stats.pending_output, chunk);
+  EXPECT_EQ(chunk_stats.bytes_out + chunk_stats.pending_output, chunked);
+  auto received = read_all(chunked);
+  ASSERT_EQ(received.size(), chunked);
+  for (std::size_t i = 0; i < received.size(); i += chunk) {
+    ASSERT_EQ(received[i], static_cast<char>('a' + i / chunk % 26));
+    ASSERT_EQ(received[i + chunk - 1], received[i]);
+  }
+
+  // more spans than one writev takes, the kernel takes a part of them.
+  ASSERT_EQ(::write(fd, "b", 1), 1);
+  received = read_all(spans * span_size);
+  ASSERT_TRUE(spanned);
+  EXPECT_EQ(span_stats.writes, 1);
+  EXPECT_GT(span_stats.bytes_out, 0);
+  EXPECT_EQ(span_stats.bytes_out + span_stats.pending_output,
+            spans * span_size);
+  ASSERT_EQ(received.size(), spans * span_size);
+  for (std::size_t i = 0; i < spans; ++i) {
+    auto expected = static_cast<char>('A' + i % 26);
+    ASSERT_EQ(received[i * span_size], expected);
+    ASSERT_EQ(received[(i + 1) * span_size - 1], expected);
+  }
+
+  ::close(fd);
+  runner.Stop();
+}
+
+TEST(TcpServeTest, testCork) {
+  using hare::net::TcpSession;
+
+  constexpr std::uint16_t port = 19715;
+  constexpr std::int32_t messages = 10;
+  std::atomic<std::int32_t> checked{0};
+
+  auto on_session = [&](const hare::Ptr<TcpSession>& _session) {
+    _session->SetConnectCallback(
+        [](const hare::Ptr<TcpSession>&, std::uint8_t) {});
+    _session->SetWriteCallback([](const hare::Ptr<TcpSession>&) {});
+    _session->SetReadCallback([&](const hare::Ptr<TcpSession>& _tcp,
+                                  hare::net::Buffer& _buffer,
+                                  const hare::Timestamp&) {
+      _buffer.ClearAll();
+      auto before = _tcp->Stats();
+      if (checked == 0) {
+        // held until uncorked, then written at once.
+        _tcp->Cork();
+        for (auto i = 0; i < messages; ++i) {
+          _tcp->Send("0123456789", 10);
+        }
+        auto corked = _tcp->Stats();
+        EXPECT_EQ(corked.writes, before.writes);
+        EXPECT_EQ(corked.pending_output, messages * 10);
+        _tcp->Uncork();
+        _tcp->OwnerCycle()->QueueInCycle([&, _tcp, before] {
+          auto uncorked = _tcp->Stats();
+          EXPECT_EQ(uncorked.writes, before.writes + 1);
+          EXPECT_EQ(uncorked.pending_output, 0);
+          checked = 1;
+        });
+        return;
+      }
+
+      // held until the end of the cycle turn.
+      _tcp->SetAutoCork(true);
+      for (auto i = 0; i < messages; ++i) {
+        _tcp->Send("abcdefghij", 10);
+      }
+      auto corked = _tcp->Stats();
+      EXPECT_EQ(corked.writes, before.writes);
+      EXPECT_EQ(corked.pending_output, messages * 10);
+      // queued after the flush of the turn.
+      _tcp->OwnerCycle()->QueueInCycle([&, _tcp, before] {
+        auto flushed = _tcp->Stats();
+        EXPECT_EQ(flushed.writes, before.writes + 1);
+        EXPECT_EQ(flushed.pending_output, 0);
+        checked = 2;
+      });
+    });
+  };
+  ServeRunner runner(port, "CORK_TEST", on_session);
+  ASSERT_TRUE(runner.Listening());
+
+  auto fd = runner.Connect();
+  ASSERT_GE(fd, 0);
+  std::string expected{};
+  for (auto i = 0; i < messages; ++i) {
+    expected += "0123456789";
+  }
+  for (auto i = 0; i < messages; ++i) {
+    expected += "abcdefghij";
+  }
+
+  std::string received(expected.size(), '\0');
+  std::size_t total{0};
+  ASSERT_EQ(::write(fd, "a", 1), 1);
+  while (total < expected.size() / 2) {
+    auto read_n = ::read(fd, &received[total], received.size() - total);
+    ASSERT_GT(read_n, 0);
+    total += static_cast<std::size_t>(read_n);
+  }
+  for (auto i = 0; i < 1000 && checked != 1; ++i) {
+    ::usleep(1000);
+  }
+  ASSERT_EQ(checked, 1);
+  ASSERT_EQ(::write(fd, "b", 1), 1);
+  while (total < expected.size()) {
+    auto read_n = ::read(fd, &received[total], received.size() - total);
+    ASSERT_GT(read_n, 0);
+    total += static_cast<std::size_t>(read_n);
+  }
+  for (auto i = 0; i < 1000 && checked != 2; ++i) {
+    ::usleep(1000);
+  }
+  EXPECT_EQ(checked, 2);
+  EXPECT_EQ(received, expected);
+
+  ::close(fd);
+  runner.Stop();
+}
+
+TEST(TcpServeTest, testFlowControl) {
+  using hare::net::TcpSession;
+
+  constexpr std::uint16_t port = 19716;
+  constexpr std::size_t high_water = 1024 * 1024;
+  constexpr std::size_t total = 32 * 1024 * 1024;
+  std::atomic<std::size_t> received{0};
+  std::atomic<std::int32_t> crossed{0};
+
+  auto on_session = [&](const hare::Ptr<TcpSession>& _session) {
+    _session->SetConnectCallback(
+        [](const hare::Ptr<TcpSession>&, std::uint8_t) {});
+    _session->SetWriteCallback([](const hare::Ptr<TcpSession>&) {});
+    _session->SetReadCallback([&](const hare::Ptr<TcpSession>& _tcp,
+                                  hare::net::Buffer& _buffer,
+                                  const hare::Timestamp&) {
+      received += _buffer.Size();
+      _tcp->Append(_buffer);
+    });
+    _session->SetHighWaterMark(high_water);
+    _session->SetLowWaterMark(high_water / 4);
+    _session->SetFlowControl(true);
+    _session->SetHighWaterCallback(
+        [&](const hare::Ptr<TcpSession>&) { ++crossed; });
+  };
+  ServeRunner runner(port, "FLOW_CONTROL_TEST", on_session);
+  ASSERT_TRUE(runner.Listening());
+
+  auto fd = runner.Connect();
+  ASSERT_GE(fd, 0);
+  std::thread writer([&] {
+    std::string bulk(total, 'x');
+    std::size_t written{0};
+    while (written < total) {
+      auto write_n = ::write(fd, bulk.data() + written, total - written);
+      if (write_n <= 0) {
+        break;
+      }
+      written += static_cast<std::size_t>(write_n);
+    }
+  });
+
+  // the echo is not read, so the session stops reading at the high water.
+  for (auto i = 0; i < 5000 && crossed == 0; ++i) {
+    ::usleep(1000);
+  }
+  ASSERT_EQ(crossed, 1);
+  ::usleep(50 * 1000);
+  auto paused = received.load();
+  ::usleep(50 * 1000);
+  EXPECT_EQ(received, paused);
+  EXPECT_LT(paused, total);
+
+  // resumed when the echo drains to the low water.
+  std::vector<char> echoed(64 * 1024);
+  std::size_t read_total{0};
+  while (read_total < total) {
+    auto read_n = ::read(fd, echoed.data(), echoed.size());
+    ASSERT_GT(read_n, 0);
+    read_total += static_cast<std::size_t>(read_n);
+  }
+  EXPECT_EQ(read_total, total);
+  EXPECT_EQ(received, total);
+
+  writer.join();
+  ::close(fd);
+  runner.Stop();
+}
+
+TEST(TcpServeTest, testFlowSource) {
+  using hare::net::TcpSession;
+
+  constexpr std::uint16_t port = 19717;
+  constexpr std::size_t high_water = 1024 * 1024;
+  constexpr std::size_t total = 32 * 1024 * 1024;
+  std::mutex mutex{};
+  hare::Ptr<TcpSession> source{};
+  hare::Ptr<TcpSession> sink{};
+  std::atomic<std::int32_t> sessions{0};
+  std::atomic<std::size_t> received{0};
+
+  auto on_session = [&](const hare::Ptr<TcpSession>& _session) {
+    _session->SetConnectCallback(
+        [](const hare::Ptr<TcpSession>&, std::uint8_t) {});
+    _session->SetWriteCallback([](const hare::Ptr<TcpSession>&) {});
+    _session->SetReadCallback([&](const hare::Ptr<TcpSession>&,
+                                  hare::net::Buffer& _buffer,
+                                  const hare::Timestamp&) {
+      received += _buffer.Size();
+      std::lock_guard<std::mutex> lock(mutex);
+      sink->Append(_buffer);
+    });
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!source) {
+      source = _session;
+    } else {
+      // the output of sink pauses the reading of source.
+      sink = _session;
+      sink->SetHighWaterMark(high_water);
+      sink->SetLowWaterMark(high_water / 4);
+      sink->SetFlowSource(source);
+      sink->SetFlowControl(true);
+    }
+    ++sessions;
+  };
+  ServeRunner runner(port, "FLOW_SOURCE_TEST", on_session);
+  ASSERT_TRUE(runner.Listening());
+
+  auto source_fd = runner.Connect();
+  ASSERT_GE(source_fd, 0);
+  for (auto i = 0; i < 1000 && sessions < 1; ++i) {
+    ::usleep(1000);
+  }
+  auto sink_fd = runner.Connect();
+  ASSERT_GE(sink_fd, 0);
+  for (auto i = 0; i < 1000 && sessions < 2; ++i) {
+    ::usleep(1000);
+  }
+  ASSERT_EQ(sessions, 2);
+  std::thread writer([&] {
+    std::string bulk(total, 'x');
+    std::size_t written{0};
+    while (written < total) {
+      auto write_n =
+          ::write(source_fd, bulk.data() + written, total - written);
+      if (write_n <= 0) {
+        break;
+      }
+      written += static_cast<std::size_t>(write_n);
+    }
+  });
+
+  // the sink is not read, so the source stops reading.
+  for (auto i = 0; i < 1000 && received < high_water; ++i) {
+    ::usleep(1000);
+  }
+  ::usleep(50 * 1000);
+  auto paused = received.load();
+  ::usleep(50 * 1000);
+  EXPECT_EQ(received, paused);
+  EXPECT_LT(paused, total);
+
+  std::vector<char> forwarded(64 * 1024);
+  std::size_t read_total{0};
+  while (read_total < total) {
+    auto read_n = ::read(sink_fd, forwarded.data(), forwarded.size());
+    ASSERT_GT(read_n, 0);
+    read_total += static_cast<std::size_t>(read_n);
+  }
+  EXPECT_EQ(read_total, total);
+  EXPECT_EQ(received, total);
+
+  writer.join();
+  ::close(source_fd);
+  ::close(sink_fd);
+  runner.Stop([&] {
+    std::lock_guard<std::mutex> lock(mutex);
+    source.reset();
+    sink.reset();
+  });
+}
+
+TEST(TcpServeTest, testTimeout) {
+  using hare::net::SessionTimeout;
+  using hare::net::TcpSession;
+
+  constexpr std::uint16_t port = 19718;
+  constexpr std::int64_t timeout = 200 * 1000;
+  constexpr std::int32_t kIdle = 0;
+  constexpr std::int32_t kRead = 1;
+  constexpr std::int32_t kWrite = 2;
+  constexpr std::int32_t kActive = 3;
+  std::atomic<std::int32_t> mode{0};
+  std::atomic<std::int32_t> sessions{0};
+  std::mutex mutex{};
+  std::map<std::int32_t, SessionTimeout> reasons{};
+
+  auto on_session = [&](const hare::Ptr<TcpSession>& _session) {
+    auto which = mode.load();
+    _session->SetConnectCallback(
+        [&, which](const hare::Ptr<TcpSession>& _tcp, std::uint8_t _events) {
+          if ((_events & hare::net::SESSION_CLOSED) != 0) {
+            EXPECT_NE(_events & hare::net::SESSION_TIMEOUT, 0);
+            std::lock_guard<std::mutex> lock(mutex);
+            reasons[which] = _tcp->TimeoutReason();
+          }
+        });
+    _session->SetWriteCallback([](const hare::Ptr<TcpSession>&) {});
+    _session->SetReadCallback([&, which](const hare::Ptr<TcpSession>& _tcp,
+                                         hare::net::Buffer& _buffer,
+                                         const hare::Timestamp&) {
+      _buffer.ClearAll();
+      if (which == kWrite) {
+        // never read by the peer, so the output makes no progress.
+        std::string bulk(64 * 1024 * 1024, 'x');
+        _tcp->Send(bulk.data(), bulk.size());
+      }
+    });
+    switch (which) {
+      case kIdle:
+      case kActive:
+        _session->SetIdleTimeout(which == kIdle ? timeout : 2 * timeout);
+        break;
+      case kRead:
+        _session->SetReadTimeout(timeout);
+        break;
+      default:
+        _session->SetWriteTimeout(timeout);
+        break;
+    }
+    ++sessions;
+  };
+  ServeRunner runner(port, "TIMEOUT_TEST", on_session);
+  ASSERT_TRUE(runner.Listening());
+
+  std::array<hare::util_socket_t, 4> fds{};
+  for (auto i = 0; i < static_cast<std::int32_t>(fds.size()); ++i) {
+    mode = i;
+    fds[i] = runner.Connect();
+    ASSERT_GE(fds[i], 0);
+    for (auto j = 0; j < 1000 && sessions <= i; ++j) {
+      ::usleep(1000);
+    }
+    ASSERT_EQ(sessions, i + 1);
+  }
+  ASSERT_EQ(::write(fds[kWrite], "w", 1), 1);
+
+  // the activity keeps pushing the idle deadline.
+  auto closed = [&](std::int32_t _which) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return reasons.count(_which) != 0;
+  };
+  for (auto i = 0; i < 8; ++i) {
+    ASSERT_EQ(::write(fds[kActive], "a", 1), 1);
+    ::usleep(static_cast<useconds_t>(timeout / 2));
+    ASSERT_FALSE(closed(kActive));
+  }
+  for (auto i = 0; i < 1000 && !closed(kActive); ++i) {
+    ::usleep(1000);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    EXPECT_EQ(reasons[kIdle], hare::net::TIMEOUT_IDLE);
+    EXPECT_EQ(reasons[kRead], hare::net::TIMEOUT_READ);
+    EXPECT_EQ(reasons[kWrite], hare::net::TIMEOUT_WRITE);
+    EXPECT_EQ(reasons[kActive], hare::net::TIMEOUT_IDLE);
+  }
+  for (auto fd : fds) {
+    ::close(fd);
+  }
+  runner.Stop();
+}
+
+TEST(TcpServeTest, testMigrateStop) {
+  using hare::net::TcpSession;
+
+  constexpr std::uint16_t port = 19719;
+  constexpr std::size_t connections = 64;
+  std::mutex mutex{};
+  std::vector<hare::Ptr<TcpSession>> accepted{};
+  std::atomic<std::size_t> closed{0};
+
+  auto on_session = [&](const hare::Ptr<TcpSession>& _session) {
+    _session->SetConnectCallback(
+        [&](const hare::Ptr<TcpSession>&, std::uint8_t _events) {
+          if ((_events & hare::net::SESSION_CLOSED) != 0) {
+            ++closed;
+          }
+        });
+    _session->SetReadCallback([](const hare::Ptr<TcpSession>&,
+                                 hare::net::Buffer& _buffer,
+                                 const hare::Timestamp&) {
+      _buffer.ClearAll();
+    });
+    std::lock_guard<std::mutex> lock(mutex);
+    accepted.push_back(_session);
+  };
+  ServeRunner runner(port, "MIGRATE_STOP_TEST", on_session);
+  ASSERT_TRUE(runner.Listening());
+
+  std::vector<hare::util_socket_t> fds{};
+  for (std::size_t i = 0; i < connections; ++i) {
+    fds.push_back(runner.Connect());
+    ASSERT_GE(fds.back(), 0);
+  }
+  for (auto i = 0; i < 1000; ++i) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (accepted.size() == connections) {
+        break;
+      }
+    }
+    ::usleep(1000);
+  }
+
+  // the pool is stopped while the sessions of one worker are being
+  // migrated, the worker is held, so the others stop first.
+  runner.Stop([&] {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto* source = accepted.front()->OwnerCycle();
+    source->QueueInCycle([] { ::usleep(50 * 1000); });
+    for (std::size_t i = 0; i < accepted.size(); ++i) {
+      if (accepted[i]->OwnerCycle() == source) {
+        EXPECT_TRUE(runner.serve()->Migrate(accepted[i], i % kWorkers));
+      }
+    }
+    accepted.clear();
+  });
+  EXPECT_EQ(closed, connections);
+
+  for (auto fd : fds) {
+    ::close(fd);
+  }
+}
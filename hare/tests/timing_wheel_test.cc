@@ -0,0 +1,105 @@
+#include <gtest/gtest.h>
+#include <hare/base/io/cycle.h>
+#include <hare/base/time/timestamp.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "net/timing_wheel.h"
+
+namespace {
+
+class FakeSession {
+  hare::io::Cycle* cycle_{nullptr};
+  std::int64_t wheel_deadline_{0};
+  std::int64_t deadline_{0};
+
+ public:
+  std::int64_t fired{0};
+  std::int32_t checks{0};
+
+  FakeSession(hare::io::Cycle* _cycle, std::int64_t _deadline)
+      : cycle_(_cycle), deadline_(_deadline) {}
+
+  auto OwnerCycle() const -> hare::io::Cycle* { return cycle_; }
+  auto WheelDeadline() const -> std::int64_t { return wheel_deadline_; }
+  void SetWheelDeadline(std::int64_t _deadline) {
+    wheel_deadline_ = _deadline;
+  }
+
+  auto CheckTimeout(std::int64_t _now) -> std::int64_t {
+    ++checks;
+    if (_now < deadline_) {
+      return deadline_;
+    }
+    fired = _now;
+    return 0;
+  }
+};
+
+}  // namespace
+
+TEST(TimingWheelTest, testWrapAround) {
+  using Wheel = hare::net::BasicTimingWheel<FakeSession>;
+
+  // the span is 8ms, so the later deadlines go round the wheel.
+  constexpr std::int64_t tick = 2 * 1000;
+  constexpr std::size_t slots = 4;
+  const std::vector<std::int64_t> delays{5 * 1000, 20 * 1000, 50 * 1000};
+
+  std::vector<hare::Ptr<FakeSession>> sessions{};
+  hare::Ptr<FakeSession> moved{};
+  std::int64_t start{0};
+  hare::io::Cycle* cycle{nullptr};
+  std::atomic<Wheel*> running{nullptr};
+  std::thread cycle_thread([&] {
+    hare::io::Cycle local(hare::io::Cycle::REACTOR_TYPE_EPOLL);
+    Wheel wheel(&local, tick, slots);
+    cycle = &local;
+    local.QueueInCycle([&] { running = &wheel; });
+    local.Exec();
+    EXPECT_EQ(wheel.size(), 0);
+  });
+  while (running == nullptr) {
+    std::this_thread::yield();
+  }
+  auto& wheel = *running.load();
+
+  cycle->RunInCycle([&] {
+    start = hare::Timestamp::Now().microseconds_since_epoch();
+    for (auto delay : delays) {
+      auto deadline = start + delay;
+      sessions.push_back(std::make_shared<FakeSession>(cycle, deadline));
+      wheel.Add(sessions.back(), deadline);
+    }
+    // the later deadline is ignored, the earlier one takes over.
+    moved = std::make_shared<FakeSession>(cycle, start + 10 * 1000);
+    wheel.Add(moved, start + 40 * 1000);
+    wheel.Add(moved, start + 60 * 1000);
+    EXPECT_EQ(wheel.size(), delays.size() + 1);
+    wheel.Add(moved, start + 10 * 1000);
+    EXPECT_EQ(wheel.size(), delays.size() + 2);
+  });
+  cycle->RunAfter([cycle] { cycle->Exit(); }, 100 * 1000);
+  cycle_thread.join();
+
+  ASSERT_EQ(sessions.size(), delays.size());
+  for (std::size_t i = 0; i < delays.size(); ++i) {
+    EXPECT_GE(sessions[i]->fired, start + delays[i]);
+    if (i > 0) {
+      EXPECT_GT(sessions[i]->fired, sessions[i - 1]->fired);
+    }
+  }
+  // checked once per span at least until the deadline.
+  EXPECT_GE(sessions.back()->checks, 50 / 8);
+  EXPECT_GE(moved->fired, start + 10 * 1000);
+  EXPECT_LT(moved->fired, start + 40 * 1000);
+  EXPECT_LE(moved->checks, 2);
+}
+
+auto main(int argc, char** argv) -> int {
+  ::testing::InitGoogleTest(&argc, argv);
+
+  return RUN_ALL_TESTS();
+}
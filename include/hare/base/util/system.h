@@ -26,6 +26,7 @@ HARE_API auto PageSize() -> std::size_t;
 HARE_API auto CpuUsage(std::int32_t _pid) -> double;
 HARE_API auto StackTrace(bool _demangle) -> std::string;
 HARE_API auto SetCurrentThreadName(const char* _tname) -> bool;
+HARE_API auto SetCurrentThreadAffinity(std::int32_t _cpu) -> bool;
 HARE_API auto ErrnoStr(std::int32_t _errorno) -> const char*;
 
 HARE_API auto LocalAddress(std::uint8_t _family,
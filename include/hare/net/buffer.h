@@ -12,8 +12,11 @@
 #ifndef _HARE_NET_BUFFER_H_
 #define _HARE_NET_BUFFER_H_
 
+#include <hare/base/time/timestamp.h>
 #include <hare/base/util/non_copyable.h>
 
+#include <atomic>
+
 #define HARE_MAX_READ_DEFAULT 4096
 
 namespace hare {
@@ -21,6 +24,60 @@ namespace net {
 
 class Buffer;
 
+using Endian = enum : std::uint8_t { ENDIAN_BIG, ENDIAN_LITTLE };
+
+/**
+ * @brief The length prefix of frame, fixed ones are big-endian.
+ **/
+using FramePrefix = enum : std::uint8_t {
+  FRAME_PREFIX_16,
+  FRAME_PREFIX_32,
+  FRAME_PREFIX_VARINT,
+};
+
+/**
+ * @brief The accountant of memory held by the blocks of buffers. Every
+ *   block is charged to the budget of its buffer and all of its parents
+ *   when allocated, and discharged when freed, even if it is moved into
+ *   another buffer. 0 limit means unlimited.
+ **/
+HARE_CLASS_API
+class HARE_API BufferBudget : public util::NonCopyable {
+  std::atomic<std::size_t> usage_{0};
+  std::atomic<std::size_t> limit_{0};
+  Ptr<BufferBudget> parent_{};
+
+ public:
+  /**
+   * @brief The process-wide budget, the default parent of all budgets.
+   **/
+  static auto Global() -> const Ptr<BufferBudget>&;
+
+  explicit BufferBudget(std::size_t _limit = 0,
+                        Ptr<BufferBudget> _parent = Global());
+
+  HARE_INLINE auto Usage() const -> std::size_t {
+    return usage_.load(std::memory_order_relaxed);
+  }
+  HARE_INLINE auto Limit() const -> std::size_t {
+    return limit_.load(std::memory_order_relaxed);
+  }
+  HARE_INLINE void SetLimit(std::size_t _limit) {
+    limit_.store(_limit, std::memory_order_relaxed);
+  }
+  HARE_INLINE auto Parent() const -> const Ptr<BufferBudget>& {
+    return parent_;
+  }
+
+  /**
+   * @brief Returns true if this budget or any of its parents is exceeded.
+   **/
+  auto Exceeded() const -> bool;
+
+  void Charge(std::size_t _size);
+  void Discharge(std::size_t _size);
+};
+
 HARE_CLASS_API
 class HARE_API BufferIterator : public util::NonCopyable {
   hare::detail::Impl* impl_{};
@@ -57,6 +114,99 @@ class HARE_API BufferIterator : public util::NonCopyable {
   friend class net::Buffer;
 };
 
+// an aggregate, so it can be returned by brace initialization in c++11.
+struct BufferSpan {
+  const char* data;
+  std::size_t size;
+};
+
+/**
+ * @brief The value-type cursor of buffer, which is trivially copyable and
+ *   never allocates. Stepping inside a block is inlined, only crossing the
+ *   boundary of blocks calls into the library. Any modification of the
+ *   buffer invalidates it.
+ *
+ *   File segments are opaque to the cursor, so it stops at the first one.
+ **/
+HARE_CLASS_API
+class HARE_API BufferCursor {
+  const void* list_{};
+  const void* node_{};
+  const char* begin_{};
+  const char* ptr_{};
+  const char* end_{};
+  std::size_t base_{0};
+
+ public:
+  BufferCursor() = default;
+
+  HARE_INLINE auto Valid() const -> bool { return ptr_ != end_; }
+
+  /**
+   * @brief The offset from the front of buffer.
+   **/
+  HARE_INLINE auto Offset() const -> std::size_t {
+    return base_ + static_cast<std::size_t>(ptr_ - begin_);
+  }
+
+  HARE_INLINE auto operator*() const -> char { return *ptr_; }
+
+  HARE_INLINE auto operator[](std::size_t _index) const -> char {
+    return _index < static_cast<std::size_t>(end_ - ptr_)
+               ? ptr_[_index]
+               : At(Offset() + _index);
+  }
+
+  HARE_INLINE auto operator++() -> BufferCursor& {
+    if (++ptr_ == end_) {
+      NextSegment();
+    }
+    return *this;
+  }
+
+  HARE_INLINE auto operator+=(std::size_t _size) -> BufferCursor& {
+    if (_size < static_cast<std::size_t>(end_ - ptr_)) {
+      ptr_ += _size;
+    } else {
+      Seek(Offset() + _size);
+    }
+    return *this;
+  }
+
+  /**
+   * @brief The rest of current block, it is empty at the end.
+   **/
+  HARE_INLINE auto Span() const -> BufferSpan {
+    return {ptr_, static_cast<std::size_t>(end_ - ptr_)};
+  }
+
+  /**
+   * @brief Moves to the beginning of the next block.
+   *
+   * @return false if there is no more block.
+   **/
+  auto NextSegment() -> bool;
+
+  /**
+   * @brief Moves to the offset from the front of buffer.
+   *
+   * @return false if the offset is out of range, and the cursor is at the
+   *   end.
+   **/
+  auto Seek(std::size_t _offset) -> bool;
+
+  /**
+   * @brief Random access by the offset from the front of buffer, '\0' is
+   *   returned if out of range.
+   **/
+  auto At(std::size_t _offset) const -> char;
+
+ private:
+  void SetEnd();
+
+  friend class net::Buffer;
+};
+
 HARE_CLASS_API
 class HARE_API Buffer : public util::NonCopyable {
   hare::detail::Impl* impl_{};
@@ -68,7 +218,7 @@ class HARE_API Buffer : public util::NonCopyable {
   ~Buffer();
 
   HARE_INLINE
-  Buffer(Buffer&& _other) noexcept { Move(_other); }
+  Buffer(Buffer&& _other) noexcept : Buffer() { Move(_other); }
 
   HARE_INLINE
   auto operator=(Buffer&& _other) noexcept -> Buffer& {
@@ -79,12 +229,41 @@ class HARE_API Buffer : public util::NonCopyable {
   auto Size() const -> std::size_t;
   void SetMaxRead(std::size_t _max_read);
   auto ChainSize() const -> std::size_t;
+
+  /**
+   * @brief The budget charged by the blocks allocated later, the global
+   *   one is used by default.
+   **/
+  void SetBudget(Ptr<BufferBudget> _budget);
+  auto Budget() const -> const Ptr<BufferBudget>&;
   void ClearAll();
   void Skip(std::size_t _size);
 
+  /**
+   * @brief Frees the blocks which hold no data, an empty buffer holds no
+   *   block after it.
+   **/
+  void ShrinkToFit();
+
+  /**
+   * @brief Drained blocks are kept to be written again. After draining, at
+   *   most `_max_retained` bytes of them are kept (128KB by default), and
+   *   all of them are freed once the buffer has been drained empty
+   *   `_idle_rounds` times in a row. 0 disables each rule.
+   **/
+  void SetTrimPolicy(std::size_t _max_retained, std::uint32_t _idle_rounds);
+
+  /**
+   * @brief Freed blocks of 4KB to 64KB are pooled by each thread for later
+   *   allocations, up to `_bytes_per_thread` (1MB by default), 0 disables
+   *   the pool. Pooled blocks are not charged to any budget.
+   **/
+  static void SetBlockPool(std::size_t _bytes_per_thread);
+
   auto Begin() -> Iterator;
   auto End() -> Iterator;
   auto Find(const char* _begin, std::size_t _size) -> Iterator;
+  auto Cursor() const -> BufferCursor;
 
   // read-write
   void Append(Buffer& _other);
@@ -92,11 +271,131 @@ class HARE_API Buffer : public util::NonCopyable {
   auto Add(const void* _bytes, std::size_t _size) -> bool;
   auto Remove(void* _buffer, std::size_t _length) -> std::size_t;
 
-  auto Read(util_socket_t _fd, std::size_t _howmuch) -> std::size_t;
-  auto Write(util_socket_t _fd, std::size_t _howmuch = 0) -> std::size_t;
+  /**
+   * @brief Copies at most `_length` bytes from the front without draining.
+   **/
+  auto Peek(void* _buffer, std::size_t _length) const -> std::size_t;
+
+  /**
+   * @brief Codec of integers. `Peek*` returns false if the buffer is not
+   *   long enough and leaves the buffer untouched, `Read*` drains the
+   *   integer on success.
+   **/
+  auto AddInt8(std::uint8_t _value) -> bool;
+  auto AddInt16(std::uint16_t _value, Endian _endian = ENDIAN_BIG) -> bool;
+  auto AddInt32(std::uint32_t _value, Endian _endian = ENDIAN_BIG) -> bool;
+  auto AddInt64(std::uint64_t _value, Endian _endian = ENDIAN_BIG) -> bool;
+  auto PeekInt8(std::uint8_t& _value) const -> bool;
+  auto PeekInt16(std::uint16_t& _value, Endian _endian = ENDIAN_BIG) const
+      -> bool;
+  auto PeekInt32(std::uint32_t& _value, Endian _endian = ENDIAN_BIG) const
+      -> bool;
+  auto PeekInt64(std::uint64_t& _value, Endian _endian = ENDIAN_BIG) const
+      -> bool;
+  auto ReadInt8(std::uint8_t& _value) -> bool;
+  auto ReadInt16(std::uint16_t& _value, Endian _endian = ENDIAN_BIG) -> bool;
+  auto ReadInt32(std::uint32_t& _value, Endian _endian = ENDIAN_BIG) -> bool;
+  auto ReadInt64(std::uint64_t& _value, Endian _endian = ENDIAN_BIG) -> bool;
+
+  /**
+   * @brief Codec of base 128 varints.
+   *
+   * @return The size of varint, 0 if incomplete, -1 if malformed.
+   **/
+  auto AddVarint(std::uint64_t _value) -> bool;
+  auto PeekVarint(std::uint64_t& _value) const -> std::int32_t;
+  auto ReadVarint(std::uint64_t& _value) -> std::int32_t;
+
+  /**
+   * @brief Codec of length-prefixed frames. `PeekFrame` only succeeds when
+   *   the whole frame is present, `_header` is the size of prefix and
+   *   `_length` is the size of payload. `ReadFrame` drains the frame and
+   *   appends its payload to `_frame`, which cannot be this buffer.
+   *   `AddFrame` adds nothing if the whole frame does not fit.
+   *
+   * @return 1 if a frame is present, 0 if incomplete, -1 if malformed.
+   **/
+  auto AddFrame(const void* _bytes, std::size_t _size,
+                FramePrefix _prefix = FRAME_PREFIX_32) -> bool;
+  auto PeekFrame(std::size_t& _header, std::size_t& _length,
+                 FramePrefix _prefix = FRAME_PREFIX_32) const -> std::int32_t;
+  auto ReadFrame(Buffer& _frame, FramePrefix _prefix = FRAME_PREFIX_32)
+      -> std::int32_t;
+
+  /**
+   * @brief Appends [_offset, _offset + _length) of the file as a segment.
+   *   The segment is sent by sendfile(2) in order with the memory blocks,
+   *   and is never copied into the user-space. The file will be closed
+   *   after the segment is released if `_auto_close` is true.
+   *
+   *   File segments are opaque to the iterator.
+   **/
+  auto AddFile(std::int32_t _fd, std::int64_t _offset, std::size_t _length,
+               bool _auto_close = false) -> bool;
+
+  /**
+   * @brief Reads at most `_howmuch` bytes (0 means no limit) from the socket
+   *   by one readv(2). The size of blocks prepared in the buffer is learned
+   *   from the previous reads, and the overflow goes into a per-thread spill
+   *   area before being copied into the buffer.
+   *
+   * @return The number of bytes read, 0 on EOF, -1 on error with errno set.
+   **/
+  auto Read(util_socket_t _fd, std::size_t _howmuch = 0) -> std::int64_t;
+
+  /**
+   * @brief Same as above, but by recvmsg(2), and `_kernel_time` is set to
+   *   the time the kernel received the data, or an invalid timestamp if the
+   *   socket does not report it (see `Socket::SetRecvTimestamp`). For TCP
+   *   the kernel reports the last skb consumed by the read.
+   **/
+  auto Read(util_socket_t _fd, Timestamp& _kernel_time,
+            std::size_t _howmuch = 0) -> std::int64_t;
+
+  /**
+   * @brief Writes at most `_howmuch` bytes (0 means all) until the socket
+   *   cannot accept more.
+   *
+   * @return The number of bytes written, -1 on error with errno set. A file
+   *   segment truncated by others is dropped with EIO.
+   **/
+  auto Write(util_socket_t _fd, std::size_t _howmuch = 0) -> std::int64_t;
+
+  /**
+   * @brief Memory blocks are sent with MSG_ZEROCOPY by `Write()` when at
+   *   least `_threshold` bytes are gathered, 0 means disabled. SO_ZEROCOPY
+   *   must be enabled on the socket. The sent blocks are pinned until their
+   *   completions are reaped from the error queue by `ReapZeroCopy()`.
+   **/
+  void SetZeroCopy(std::size_t _threshold);
+  auto ZeroCopyPending() const -> std::size_t;
+
+  /**
+   * @brief Once the buffer holds `_threshold` bytes, the data added later
+   *   goes to an unnamed temporary file of this buffer instead of memory,
+   *   and is sent by sendfile(2) in order with the memory blocks. Adjacent
+   *   spills extend one file segment, and the file is truncated after the
+   *   buffer is written out. 0 means disabled, the data stays in memory if
+   *   the file cannot be created or written.
+   *
+   * @return `Spilled()` is the number of bytes held by the file.
+   **/
+  void SetSpill(std::size_t _threshold);
+  auto Spilled() const -> std::size_t;
+
+  /**
+   * @brief Reaps the completions from the error queue of the socket, and
+   *   releases the blocks which are no longer referred by the kernel.
+   *
+   * @return The number of completed sends.
+   **/
+  auto ReapZeroCopy(util_socket_t _fd) -> std::size_t;
 
  private:
   void Move(Buffer& _other) noexcept;
+  void CopyFrom(Buffer& _other);
+  auto ReadV(util_socket_t _fd, std::size_t _howmuch, Timestamp* _kernel_time)
+      -> std::int64_t;
 };
 
 }  // namespace net
@@ -38,6 +38,10 @@ using Errors = enum : std::int32_t {
   ERROR_SESSION_ALREADY_DISCONNECT,
   ERROR_GET_SOCKET_PAIR,
   ERROR_INIT_IO_POOL,
+  ERROR_SOCKET_ZERO_COPY,
+  ERROR_SOCKET_TCP_CORK,
+  ERROR_SOCKET_NOTSENT_LOWAT,
+  ERROR_SOCKET_TIMESTAMP,
 
   ERRORS_NBR
 };
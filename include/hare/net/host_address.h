@@ -15,6 +15,11 @@
 #include <hare/base/io/operation.h>
 #include <hare/base/util/non_copyable.h>
 
+#include <type_traits>
+
+// large enough for `sockaddr_in6`.
+#define HARE_SOCKADDR_SIZE 28
+
 struct sockaddr;
 
 namespace hare {
@@ -22,7 +27,8 @@ namespace net {
 
 HARE_CLASS_API
 class HARE_API HostAddress : public util::NonCopyable {
-  sockaddr* in_{};
+  // stored inline, so no allocation is needed per address.
+  mutable std::aligned_storage<HARE_SOCKADDR_SIZE, 4>::type in_{};
 
  public:
   /**
@@ -58,7 +64,9 @@ class HARE_API HostAddress : public util::NonCopyable {
 
   auto Family() const -> std::uint8_t;
 
-  HARE_INLINE auto get_sockaddr() const -> sockaddr* { return in_; }
+  HARE_INLINE auto get_sockaddr() const -> sockaddr* {
+    return reinterpret_cast<sockaddr*>(&in_);
+  }
 
   auto ToIp() const -> std::string;
   auto ToIpPort() const -> std::string;
@@ -71,8 +79,6 @@ class HARE_API HostAddress : public util::NonCopyable {
 
   // set IPv6 ScopeID
   void SetScopeId(std::uint32_t _id) const;
-
-  friend class Socket;
 };
 
 }  // namespace net
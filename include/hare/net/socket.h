@@ -31,6 +31,19 @@ static constexpr const char* type_name[] HARE_NET_TYPE;
 HARE_INLINE
 constexpr const char* TypeToStr(Type _type) { return type_name[_type]; }
 
+/**
+ * @brief The part of TCP_INFO, the times are in microseconds.
+ **/
+struct TcpInfo {
+  std::uint32_t rtt{0};
+  std::uint32_t rtt_var{0};
+  // the congestion window in segments.
+  std::uint32_t snd_cwnd{0};
+  // the timeouts not recovered yet, and the retransmits in total.
+  std::uint32_t retransmits{0};
+  std::uint32_t total_retrans{0};
+};
+
 HARE_CLASS_API
 class HARE_API Socket : public util::NonCopyable {
   util_socket_t socket_{-1};
@@ -67,6 +80,13 @@ class HARE_API Socket : public util::NonCopyable {
    */
   auto SetTcpNoDelay(bool _no_delay) const -> Error;
 
+  /**
+   * @brief Enable/disable TCP_CORK, partial frames are held by the kernel
+   *   until it is disabled.
+   *
+   */
+  auto SetTcpCork(bool _cork) const -> Error;
+
   /**
    * @brief Enable/disable SO_REUSEADDR
    *
@@ -84,6 +104,42 @@ class HARE_API Socket : public util::NonCopyable {
    *
    */
   auto SetKeepAlive(bool _keep_alive) const -> Error;
+
+  /**
+   *  @brief Enable/disable SO_ZEROCOPY, required by sending with MSG_ZEROCOPY.
+   *
+   */
+  auto SetZeroCopy(bool _zero_copy) const -> Error;
+
+  /**
+   *  @brief Set TCP_NOTSENT_LOWAT, the socket is writable only when less
+   *    than `_bytes` are not sent yet, 0 falls back to the sysctl
+   *    net.ipv4.tcp_notsent_lowat.
+   *
+   */
+  auto SetNotSentLowat(std::uint32_t _bytes) const -> Error;
+
+  /**
+   *  @brief Set SO_TIMESTAMPNS, the kernel stamps every received packet
+   *    with the time it arrived.
+   *
+   */
+  auto SetRecvTimestamp(bool _enable) const -> Error;
+
+  /**
+   *  @brief The bytes in the send queue of kernel which are not acked
+   *    (SIOCOUTQ), and the part of them not sent yet (SIOCOUTQNSD).
+   *    -1 if not supported.
+   *
+   */
+  auto KernelQueued() const -> std::int64_t;
+  auto KernelUnsent() const -> std::int64_t;
+
+  /**
+   *  @brief Reads TCP_INFO, returns false if not supported.
+   *
+   */
+  auto GetTcpInfo(TcpInfo& _info) const -> bool;
 };
 
 }  // namespace net
@@ -19,6 +19,19 @@ namespace net {
 
 class Acceptor;
 
+using AcceptMode = enum : std::uint8_t {
+  ACCEPT_MAIN = 0x00,
+  ACCEPT_REUSE_PORT
+};
+
+using PlacementPolicy = enum : std::uint8_t {
+  PLACEMENT_ROUND_ROBIN = 0x00,
+  PLACEMENT_LEAST_CONNECTIONS,
+  PLACEMENT_LEAST_BYTES,
+  PLACEMENT_POWER_OF_TWO,
+  PLACEMENT_INCOMING_CPU
+};
+
 HARE_CLASS_API
 class HARE_API TcpServe : public util::NonCopyable {
   hare::detail::Impl* impl_{};
@@ -34,14 +47,97 @@ class HARE_API TcpServe : public util::NonCopyable {
   auto IsRunning() const -> bool;
   void SetNewSession(NewSessionCallback _new_session);
 
+  /**
+   * @brief By default, sessions are accepted in the main cycle and handed
+   *   over to workers. With `ACCEPT_REUSE_PORT`, each worker listens on its
+   *   own socket of every acceptor by SO_REUSEPORT and accepts sessions
+   *   locally, the acceptor added is only a template, and its port must
+   *   be non-zero. It must be set before adding acceptors.
+   **/
+  void SetAcceptMode(AcceptMode _mode);
+  auto GetAcceptMode() const -> net::AcceptMode;
+
+  /**
+   * @brief How `ACCEPT_MAIN` hands sessions over to workers: round robin,
+   *   the least live sessions, the least bytes moved in the last window
+   *   (1s), or the less loaded one of two random workers.
+   *   `PLACEMENT_INCOMING_CPU` pins workers to CPUs when executing, and
+   *   places a session on the worker pinned to the CPU which processed
+   *   its packets (SO_INCOMING_CPU), or the nearest one. It falls back to
+   *   round robin if the option is unavailable. The policy must be set
+   *   before executing if it pins CPUs.
+   **/
+  void SetPlacementPolicy(PlacementPolicy _policy);
+
+  /**
+   * @brief Sessions placed on the worker pinned to their incoming CPU.
+   **/
+  auto LocalityHits() const -> std::uint64_t;
+
   auto AddAcceptor(const Ptr<Acceptor>& _acceptor) -> bool;
 
+  /**
+   * @brief Sessions free their buffer blocks once they have nothing
+   *   buffered and have been idle for `_idle` us, so idle sessions hold no
+   *   buffer memory. The deadlines are kept by the timing wheel of each
+   *   worker, so only sessions that were active are visited. 0 disables it.
+   *   It must be set before executing.
+   **/
+  void SetIdleRelease(std::int64_t _idle);
+
+  /**
+   * @brief Limits the memory held by the buffers of sessions in each worker,
+   *   0 means unlimited. Sessions stop reading when it is exceeded, see
+   *   `TcpSession::SetBudgetCallback()`. Call it in the main cycle.
+   **/
+  void SetBufferBudget(std::size_t _limit_per_worker);
+
+  /**
+   * @brief The memory held by the buffers of all sessions.
+   **/
+  auto BufferUsage() const -> std::size_t;
+
+  /**
+   * @brief Moves a session of the serve to worker `_index` with its event,
+   *   buffers and timers. It is done asynchronously in the owner cycle of
+   *   the session, and can be called in any thread.
+   **/
+  auto Migrate(const Ptr<TcpSession>& _session, std::size_t _index) -> bool;
+
+  /**
+   * @brief Every `_interval` us, moves a hot session from the busiest
+   *   worker to the idlest one, if the bytes moved by the former in the
+   *   last window (1s) exceed `_ratio` times those of the latter. 0
+   *   disables it. It must be set before executing.
+   **/
+  void SetRebalance(std::int64_t _interval, double _ratio = 2.0);
+
+  /**
+   * @brief Sessions moved by `Migrate()` and the rebalancer.
+   **/
+  auto Migrations() const -> std::uint64_t;
+
   auto Exec(std::int32_t _thread_nbr) -> Error;
   void Exit();
 
  private:
   void NewSession(util_socket_t _fd, HostAddress& _address,
                   const Timestamp& _time, Acceptor* _acceptor);
+  void NewLocalSession(std::size_t _index, util_socket_t _fd,
+                       HostAddress& _address, const Timestamp& _time,
+                       Acceptor* _acceptor);
+  auto CreateSession(std::size_t _index, util_socket_t _fd,
+                     HostAddress& _address, Acceptor* _acceptor)
+      -> Ptr<TcpSession>;
+  void EstablishSession(std::size_t _index, const Ptr<TcpSession>& _session,
+                        const Timestamp& _time, Acceptor* _acceptor);
+  void BindSession(std::size_t _index, const Ptr<TcpSession>& _session);
+  void MigrateInCycle(const Ptr<TcpSession>& _session, std::size_t _index);
+  void Rebalance();
+  void RebalanceInCycle(std::size_t _from, std::size_t _to,
+                        std::uint64_t _limit);
+  void StartLocalAcceptors();
+  void StopLocalAcceptors();
 };
 
 }  // namespace net
@@ -18,11 +18,15 @@
 #include <hare/net/buffer.h>
 #include <hare/net/socket.h>
 
+#include <atomic>
+#include <initializer_list>
+
 namespace hare {
 namespace net {
 
 using SessionEvent = enum : std::uint8_t {
   SESSION_DEFAULT = io::EVENT_DEFAULT,
+  SESSION_TIMEOUT = io::EVENT_TIMEOUT,
   SESSION_READ = io::EVENT_READ,
   SESSION_WRITE = io::EVENT_WRITE,
   SESSION_CLOSED = io::EVENT_CLOSED,
@@ -37,6 +41,45 @@ using SessionState = enum : std::int8_t {
   STATE_DISCONNECTED
 };
 
+using SessionTimeout = enum : std::uint8_t {
+  TIMEOUT_NONE = 0x00,
+  TIMEOUT_IDLE,
+  TIMEOUT_READ,
+  TIMEOUT_WRITE
+};
+
+using OutputPolicy = enum : std::uint8_t {
+  OUTPUT_STRICT = 0x00,
+  OUTPUT_WEIGHTED
+};
+
+/**
+ * @brief The snapshot of a session, see `TcpSession::Stats()`.
+ **/
+struct SessionStats {
+  // held by the session, the queued messages included.
+  std::size_t pending_output{0};
+  // in the send queue of kernel and the unsent part by the last sample,
+  // -1 if never sampled.
+  std::int64_t kernel_queued{-1};
+  std::int64_t kernel_unsent{-1};
+
+  // counted since connected.
+  std::uint64_t bytes_in{0};
+  std::uint64_t bytes_out{0};
+  std::uint64_t reads{0};
+  std::uint64_t writes{0};
+  // the most output ever held by the session.
+  std::size_t output_peak{0};
+
+  // the last sample, `info_time` is invalid if never sampled.
+  TcpInfo tcp_info{};
+  Timestamp info_time{};
+};
+
+template <typename Session>
+class BasicTimingWheel;
+
 HARE_CLASS_API
 class HARE_API TcpSession : public util::NonCopyable,
                             public std::enable_shared_from_this<TcpSession> {
@@ -49,8 +92,24 @@ class HARE_API TcpSession : public util::NonCopyable,
   using HighWaterCallback = std::function<void(const hare::Ptr<TcpSession>&)>;
   using ReadRallback = std::function<void(const hare::Ptr<TcpSession>&, Buffer&,
                                           const Timestamp&)>;
+  using BudgetCallback = std::function<void(const hare::Ptr<TcpSession>&)>;
+  using SendComplete =
+      std::function<void(const hare::Ptr<TcpSession>&, bool)>;
   using SessionDestroy = std::function<void()>;
 
+  /**
+   * @brief The callbacks of sessions, one table can be shared by all
+   *   sessions of a serve instead of holding copies. The setters below copy
+   *   a shared table before changing it.
+   **/
+  struct Callbacks {
+    ConnectCallback connect{};
+    ReadRallback read{};
+    WriteCallback write{};
+    HighWaterCallback high_water{};
+    BudgetCallback budget{};
+  };
+
   virtual ~TcpSession();
 
   auto Name() const -> std::string;
@@ -64,8 +123,55 @@ class HARE_API TcpSession : public util::NonCopyable,
   void SetReadCallback(ReadRallback _read);
   void SetWriteCallback(WriteCallback _write);
   void SetHighWaterCallback(HighWaterCallback _high_water);
+  void SetCallbacks(const Ptr<const Callbacks>& _callbacks);
   void SetHighWaterMark(std::size_t _hwm);
 
+  /**
+   * @brief Flow control of reading, off by default. When the output crosses
+   *   the high water mark, the session stops reading until the output
+   *   drains to the low water mark (0 by default). For proxies, the reading
+   *   of `_source` is paused instead, usually the peer session which feeds
+   *   this one.
+   **/
+  void SetLowWaterMark(std::size_t _lwm);
+  void SetFlowControl(bool _on);
+  void SetFlowSource(const Ptr<TcpSession>& _source);
+
+  /**
+   * @brief The budget charged by the buffers of session. By default, the
+   *   session stops reading when the budget is exceeded, and resumes when
+   *   there is room again. If the callback is set, it will be called after
+   *   every read while exceeded instead.
+   **/
+  void SetBufferBudget(const Ptr<BufferBudget>& _budget);
+  void SetBudgetCallback(BudgetCallback _budget);
+
+  /**
+   * @brief The trim policy of both buffers, see `Buffer::SetTrimPolicy()`.
+   **/
+  void SetBufferTrim(std::size_t _max_retained, std::uint32_t _idle_rounds);
+
+  /**
+   * @brief In shared read mode, the data is read into a scratch buffer
+   *   shared by the sessions of the owner cycle, only the bytes left by the
+   *   read callback are copied into the session's buffer. It suits small
+   *   frames consumed at once, a session without a partial frame holds no
+   *   receive memory then. Must be called in the owner cycle.
+   **/
+  void SetSharedRead(bool _on);
+
+  /**
+   * @brief Deadlines in microseconds, 0 means disabled. The session is
+   *   closed with `SESSION_CLOSED | SESSION_TIMEOUT` when nothing is read
+   *   or written for the idle timeout, nothing is read for the read
+   *   timeout, or the pending output makes no progress for the write
+   *   timeout. `TimeoutReason()` tells which one expired.
+   **/
+  void SetIdleTimeout(std::int64_t _timeout);
+  void SetReadTimeout(std::int64_t _timeout);
+  void SetWriteTimeout(std::int64_t _timeout);
+  auto TimeoutReason() const -> SessionTimeout;
+
   void SetContext(const util::Any& context);
   auto GetContext() const -> const util::Any&;
 
@@ -80,17 +186,137 @@ class HARE_API TcpSession : public util::NonCopyable,
     return State() == STATE_CONNECTED;
   }
 
-  auto Append(Buffer& _buffer) -> bool;
-  auto Send(const void* _bytes, std::size_t _length) -> bool;
+  /**
+   * @brief Called in the owner cycle, the data is written directly if
+   *   nothing is queued, and only the remainder is buffered.
+   *
+   *   `_done` is called in the owner cycle with true once the data has been
+   *   written into the socket, or with false if the session is closed
+   *   before. Tokens are tracked by their end offset in the output, which
+   *   costs nothing per byte. It is not called if false is returned.
+   **/
+  auto Append(Buffer& _buffer, SendComplete _done = {}) -> bool;
+  auto Send(const void* _bytes, std::size_t _length, SendComplete _done = {})
+      -> bool;
+
+  /**
+   * @brief Sends the pieces in order by one task and one writev(2). Spans
+   *   are copied only when they cannot be written directly, buffers are
+   *   drained and chained without copying.
+   **/
+  auto SendV(const BufferSpan* _spans, std::size_t _count) -> bool;
+  auto SendV(Buffer* const* _buffers, std::size_t _count) -> bool;
+
+  HARE_INLINE auto SendV(std::initializer_list<BufferSpan> _spans) -> bool {
+    return SendV(_spans.begin(), _spans.size());
+  }
+  HARE_INLINE auto SendV(std::initializer_list<Buffer*> _buffers) -> bool {
+    return SendV(_buffers.begin(), _buffers.size());
+  }
 
   HARE_INLINE auto SetTcpNoDelay(bool _on) -> Error {
     return Socket().SetTcpNoDelay(_on);
   }
+  HARE_INLINE auto SetTcpCork(bool _on) -> Error {
+    return Socket().SetTcpCork(_on);
+  }
+
+  /**
+   * @brief In auto-cork mode, the output produced during a turn of cycle
+   *   is flushed once by one writev(2) after the events are dispatched.
+   *   `Cork()` holds the output until `Uncork()` explicitly, combine it
+   *   with `SetTcpCork()` to hold partial frames in the kernel as well.
+   *   They must be called in the owner cycle.
+   **/
+  void SetAutoCork(bool _on);
+  void Cork();
+  void Uncork();
+
+  /**
+   * @brief Sends the outbound data with MSG_ZEROCOPY when at least
+   *   `_threshold` bytes can be written at once, 0 means disabled.
+   *   It only pays off for multi-kilobyte writes. Not thread-safe.
+   **/
+  auto SetZeroCopy(std::size_t _threshold) -> Error;
+
+  /**
+   * @brief The output queued beyond `_threshold` bytes is spilled to a
+   *   temporary file of the session, and sent back by sendfile(2) in
+   *   order. It bounds the memory held for slow consumers without losing
+   *   data, the spilled bytes still count for the high water mark.
+   *   0 means disabled. Not thread-safe.
+   **/
+  void SetOutputSpill(std::size_t _threshold);
+
+  /**
+   * @brief Splits the output into `_count` queues of messages, queue 0 is
+   *   the most urgent. Whole messages are taken into the socket by turns,
+   *   so an urgent frame only waits for the messages already taken. With
+   *   `OUTPUT_STRICT`, a queue is served when the ones before are empty.
+   *   With `OUTPUT_WEIGHTED`, the bytes are shared by the weights of
+   *   queues (1 by default) in deficit round robin. `Send()`, `Append()`
+   *   and `SendV()` use the last queue. Must be called in the owner cycle
+   *   before any output.
+   **/
+  void SetOutputQueues(std::size_t _count,
+                       OutputPolicy _policy = OUTPUT_STRICT);
+  void SetQueueWeight(std::size_t _queue, std::uint32_t _weight);
+
+  /**
+   * @brief Sets TCP_NOTSENT_LOWAT, so the kernel holds only about `_bytes`
+   *   not sent yet, and the rest waits in the session where the output
+   *   queues can still reorder it. It cuts the head-of-line latency over
+   *   long-RTT links. 0 falls back to the sysctl net.ipv4.tcp_notsent_lowat,
+   *   and the session stages its usual amount. Must be called in the owner
+   *   cycle.
+   **/
+  auto SetNotSentLowat(std::uint32_t _bytes) -> Error;
+
+  /**
+   * @brief Asks the kernel to stamp the received packets (SO_TIMESTAMPNS),
+   *   then `ReceiveTime()` in the read callback tells when the data arrived,
+   *   while the time passed to the callback is when the cycle dispatched
+   *   it. Their difference is the delay from ingress to the callback. Must
+   *   be called in the owner cycle.
+   **/
+  auto SetRecvTimestamp(bool _on) -> Error;
+
+  /**
+   * @brief The kernel receive time reported for the last read, invalid
+   *   unless `SetRecvTimestamp(true)`. For TCP it is the timestamp of the
+   *   last skb consumed by the read, so it is the arrival of the newest
+   *   data taken, not of the oldest.
+   **/
+  auto ReceiveTime() const -> Timestamp;
+
+  /**
+   * @brief Samples TCP_INFO and the send queue of kernel every `_interval`
+   *   microseconds in the owner cycle, the first sample is taken at once.
+   *   `Stats()` returns the last sample and never asks the kernel. 0 stops
+   *   sampling. Must be called in the owner cycle.
+   **/
+  void SetStatsInterval(std::int64_t _interval);
+
+  /**
+   * @brief Must be called in the owner cycle.
+   **/
+  auto Stats() const -> SessionStats;
+  auto SendTo(std::size_t _queue, const void* _bytes, std::size_t _length,
+              SendComplete _done = {}) -> bool;
+  auto AppendTo(std::size_t _queue, Buffer& _buffer, SendComplete _done = {})
+      -> bool;
 
  protected:
   TcpSession(io::Cycle* _cycle, HostAddress _local_addr, std::string _name,
              std::uint8_t _family, util_socket_t _fd, HostAddress _peer_addr);
 
+  /**
+   * @brief The local address and the name are resolved on first use, the
+   *   name is "{_prefix}-{local ip:port}#tcp{_id}".
+   **/
+  TcpSession(io::Cycle* _cycle, std::string _prefix, std::uint64_t _id,
+             std::uint8_t _family, util_socket_t _fd, HostAddress _peer_addr);
+
   void SetState(SessionState _state);
   auto Event() -> Ptr<io::Event>&;
   auto Socket() -> net::Socket&;
@@ -103,12 +329,64 @@ class HARE_API TcpSession : public util::NonCopyable,
   void HandleWrite();
   void HandleClose();
   void HandleError();
+  void HandleBudget();
 
  private:
+  void SendInCycle(const void* _bytes, std::size_t _length);
+  void SendVInCycle(const BufferSpan* _spans, std::size_t _count);
+  void AppendInCycle(Buffer& _buffer);
+  auto CanWriteDirectly() -> bool;
+  void QueueOutput(std::size_t _before);
+  void Flush();
+  void WriteComplete();
+  void AddCompletion(SendComplete _done);
+  void QueueMessage(std::size_t _queue, Buffer& _buffer, SendComplete _done);
+  void StageOutput();
+  // errors other than EAGAIN are reported by `HandleError()`.
+  auto WriteOutput() -> std::size_t;
+  // writes the output taken by an idle session, the rest waits for writable.
+  void WriteDirectly();
+  auto PendingOutput() const -> std::size_t;
+  void CheckCompletions();
+  void NotifyCompletions();
+  void PauseRead();
+  void ThrottleRead(bool _pause);
+  void ThrottleSource(bool _pause);
+  void CheckLowWater();
+
+  auto MutableCallbacks() -> Callbacks&;
+
+  // the blocks of both buffers are freed by the timing wheel once they are
+  // empty and nothing has been read or written for `_idle` us.
+  void SetIdleRelease(std::int64_t _idle);
+  void ReleaseIdle(std::int64_t _now);
+  void RearmRelease();
+
+  void SetTrafficCounter(const Ptr<std::atomic<std::uint64_t>>& _counter);
+  void Account(std::size_t _bytes, bool _read);
+  void SampleInfo();
+  void ArmSampling();
+  // bytes moved since the last call, for rebalancing.
+  auto TakeRecentBytes() -> std::uint64_t;
+  void TouchWrite();
+  void ArmTimeout();
+  auto CheckTimeout(std::int64_t _now) -> std::int64_t;
+  auto WheelDeadline() const -> std::int64_t;
+  void SetWheelDeadline(std::int64_t _deadline);
+
   void ConnectEstablished();
 
+  /**
+   * @brief Migration, `Detach()` is called in the owner cycle, then
+   *   `Attach()` in the new one.
+   **/
+  void Detach(io::Cycle* _cycle);
+  void Attach();
+
   friend class TcpClient;
   friend class TcpServe;
+  template <typename Session>
+  friend class BasicTimingWheel;
 };
 
 }  // namespace net
@@ -44,12 +44,14 @@ static void NewSession(const hare::Ptr<TcpSession>& _ses, hare::Timestamp _ts,
 
   });
 
+  // stop echoing until the peer drains the output.
+  _ses->SetHighWaterMark(static_cast<std::size_t>(4) * 1024 * 1024);
+  _ses->SetLowWaterMark(static_cast<std::size_t>(1) * 1024 * 1024);
+  _ses->SetFlowControl(true);
   _ses->SetHighWaterCallback([=](const hare::Ptr<TcpSession>& _session) {
-    LOG_ERROR(
-        server_logger,
-        "session[{}] is going offline because it is no longer receiving data.",
-        _session->Name());
-    _session->ForceClose();
+    LOG_WARNING(server_logger,
+                "session[{}] is not receiving data, reading is paused.",
+                _session->Name());
   });
 
   LOG_INFO(server_logger, "recv a new tcp-session[{}] at {} on acceptor={}.",